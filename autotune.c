@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <gmp.h>
+
+#include "engine.h"
+#include "engine_limbs.h"
+#include "engine_tune.h"
+
+// sosu autotune: times each tunable kernel on synthetic card numbers and
+// writes the fastest settings to this host's profile (engine_tune.h).
+// Knobs are tuned one after another, each on top of the earlier picks, and
+// a setting only replaces the default when it is clearly faster, so timer
+// noise does not turn into churn between runs.
+
+int program11_main(int argc, char** argv);
+
+#define REPEATS 5              // best of, to ride out scheduler noise
+#define MIN_GAIN 0.97          // a setting must beat the current pick by 3%
+#define LANE_SAMPLES (1 << 15)
+#define LIMB_SAMPLES 512
+#define SIEVE_SAMPLES 2000
+#define SIEVE_MIN_DIGITS 20    // program.c's candidates that reach the gcd
+#define SIEVE_MAX_DIGITS 90
+#define SPLIT_HAND "A23456789TJQKA23456789TJQK"
+#define SPLIT_MAX_CARDS "--max-cards=6"
+
+// 3*5*...*47, as in program.c
+#define SMALL_PRODUCT 307444891294245705UL
+
+static const int ODD_RANKS[] = {1, 3, 5, 7, 9, 11, 13};
+
+// Results land here so the timed loops cannot be optimized away
+static volatile int sink;
+
+// Random cards whose concatenation has at least `digits` digits and ends
+// in an odd card, so every candidate gets past the parity check
+static void random_card_digits(char* out, int digits, uint64_t* rng) {
+    int len = 0;
+    do {
+        len += sprintf(out + len, "%u", next_random(rng) % 13 + 1);
+    } while (len < digits - 2);
+    sprintf(out + len, "%d", ODD_RANKS[next_random(rng) % 7]);
+}
+
+static bool keep(double t, double best) {
+    return t < best * MIN_GAIN;
+}
+
+// is_prime_batch chunk width, on plays of 2..7 cards that fit 64 bits
+static double time_lanes(const unsigned long long* nums, int count) {
+    bool prime[PRIME_BATCH];
+    double best = 1e300;
+    for (int rep = 0; rep < REPEATS; rep++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i += PRIME_BATCH) {
+            is_prime_batch(nums + i, PRIME_BATCH, prime);
+            sink += prime[0];
+        }
+        double t = elapsed_ms(&start);
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static void tune_lanes(uint64_t* rng) {
+    unsigned long long* nums = malloc(LANE_SAMPLES * sizeof(*nums));
+    for (int i = 0; i < LANE_SAMPLES; i++) {
+        int cards[7];
+        int k = 2 + next_random(rng) % 6;
+        for (int j = 0; j < k - 1; j++) cards[j] = next_random(rng) % 13 + 1;
+        cards[k - 1] = ODD_RANKS[next_random(rng) % 7];
+        nums[i] = cards_value(cards, k);
+    }
+
+    static const int widths[] = {MR_LANES, 4, 2, 1};
+    double best = 0;
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        if (w > 0 && widths[w] >= MR_LANES) continue;
+        int pick = engine_tuning.mr_lanes;
+        engine_tuning.mr_lanes = widths[w];
+        double t = time_lanes(nums, LANE_SAMPLES);
+        printf("  mr_lanes=%-6d %8.1f ns/候補\n", widths[w], t * 1e6 / LANE_SAMPLES);
+        if (w == 0 || keep(t, best)) {
+            best = t;
+        } else {
+            engine_tuning.mr_lanes = pick;
+        }
+    }
+    free(nums);
+}
+
+// Base-2 strong probable-prime test on plain mpz, what the fixed-limb
+// engine replaces
+static bool mpz_sprp2(const mpz_t n, mpz_t d, mpz_t x, mpz_t nm1) {
+    mpz_sub_ui(nm1, n, 1);
+    mp_bitcnt_t s = mpz_scan1(nm1, 0);
+    mpz_tdiv_q_2exp(d, nm1, s);
+    mpz_set_ui(x, 2);
+    mpz_powm(x, x, d, n);
+    if (mpz_cmp_ui(x, 1) == 0 || mpz_cmp(x, nm1) == 0) return true;
+    for (mp_bitcnt_t r = 1; r < s; r++) {
+        mpz_powm_ui(x, x, 2, n);
+        if (mpz_cmp(x, nm1) == 0) return true;
+        if (mpz_cmp_ui(x, 1) == 0) return false;
+    }
+    return false;
+}
+
+static double time_sprp(mpz_t* nums, int count, bool fixed) {
+    mpz_t two, d, x, nm1;
+    mpz_init_set_ui(two, 2);
+    mpz_inits(d, x, nm1, NULL);
+    double best = 1e300;
+    int passed = 0;
+    for (int rep = 0; rep < REPEATS; rep++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            passed += fixed ? limbs_sprp(nums[i], two) : mpz_sprp2(nums[i], d, x, nm1);
+        }
+        double t = elapsed_ms(&start);
+        if (t < best) best = t;
+    }
+    mpz_clears(two, d, x, nm1, NULL);
+    sink += passed;
+    return best;
+}
+
+// Largest limb count up to which the fixed-limb engine beats mpz at every
+// size; larger numbers fall back to mpz
+static void tune_limbs(uint64_t* rng) {
+    mpz_t nums[LIMB_SAMPLES];
+    char text[SIEVE_MAX_DIGITS * 2];
+    for (int i = 0; i < LIMB_SAMPLES; i++) mpz_init(nums[i]);
+
+    engine_tuning.limbs_max = LIMBS_MIN - 1;
+    bool winning = true;
+    for (int limbs = LIMBS_MIN; limbs <= LIMBS_MAX; limbs++) {
+        // Aim for the middle of the size's bit range
+        int digits = (int)((64 * limbs - 32) * 0.30103);
+        for (int i = 0; i < LIMB_SAMPLES; i++) {
+            do {
+                random_card_digits(text, digits, rng);
+                mpz_set_str(nums[i], text, 10);
+            } while ((int)mpz_size(nums[i]) != limbs);
+        }
+        double fixed = time_sprp(nums, LIMB_SAMPLES, true);
+        double plain = time_sprp(nums, LIMB_SAMPLES, false);
+        printf("  %d limbs: 固定 %8.2f us, mpz %8.2f us\n", limbs, fixed * 1e3 / LIMB_SAMPLES,
+               plain * 1e3 / LIMB_SAMPLES);
+        winning = winning && fixed < plain;
+        if (winning) engine_tuning.limbs_max = limbs;
+    }
+    for (int i = 0; i < LIMB_SAMPLES; i++) mpz_clear(nums[i]);
+}
+
+// program.c's gcd prefilter and BPSW on candidates with no factor below 53
+static double time_sieve(mpz_t* nums, int count, unsigned long limit) {
+    mpz_t primorial, g;
+    mpz_inits(primorial, g, NULL);
+    mpz_primorial_ui(primorial, limit);
+    mpz_divexact_ui(primorial, primorial, 2 * SMALL_PRODUCT);
+    double best = 1e300;
+    int passed = 0;
+    for (int rep = 0; rep < REPEATS; rep++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            mpz_gcd(g, nums[i], primorial);
+            if (mpz_cmp_ui(g, 1) != 0) continue;
+            passed += limbs_fit(nums[i]) ? limbs_bpsw(nums[i]) : mpz_probab_prime_p(nums[i], 1) > 0;
+        }
+        double t = elapsed_ms(&start);
+        if (t < best) best = t;
+    }
+    mpz_clears(primorial, g, NULL);
+    sink += passed;
+    return best;
+}
+
+static void tune_sieve(uint64_t* rng) {
+    mpz_t nums[SIEVE_SAMPLES];
+    char text[SIEVE_MAX_DIGITS * 2];
+    for (int i = 0; i < SIEVE_SAMPLES; i++) {
+        mpz_init(nums[i]);
+        do {
+            int digits = SIEVE_MIN_DIGITS + next_random(rng) % (SIEVE_MAX_DIGITS - SIEVE_MIN_DIGITS + 1);
+            random_card_digits(text, digits, rng);
+            mpz_set_str(nums[i], text, 10);
+        } while (mpz_gcd_ui(NULL, nums[i], SMALL_PRODUCT) != 1);
+    }
+
+    static const int limits[] = {2000, 250, 500, 1000, 4000, 8000, 16000, 32000, 65536};
+    double best = 1e300;
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++) {
+        double t = time_sieve(nums, SIEVE_SAMPLES, limits[l]);
+        printf("  sieve_limit=%-6d %8.2f us/候補\n", limits[l], t * 1e3 / SIEVE_SAMPLES);
+        if (l == 0 || keep(t, best)) {
+            best = t;
+            engine_tuning.sieve_limit = limits[l];
+        }
+    }
+    for (int i = 0; i < SIEVE_SAMPLES; i++) mpz_clear(nums[i]);
+}
+
+// One program11 run in a child process with the given split depths, its
+// output discarded; negative when the run failed
+static double time_program11(int max_rank, int min_left) {
+    double best = 1e300;
+    for (int rep = 0; rep < 3; rep++) {
+        fflush(stdout);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = fork();
+        if (pid < 0) return -1;
+        if (pid == 0) {
+            engine_tuning.split_max_rank = max_rank;
+            engine_tuning.split_min_left = min_left;
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            char* args[] = {"program11", SPLIT_MAX_CARDS, SPLIT_HAND, NULL};
+            _exit(program11_main(3, args));
+        }
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+        double t = elapsed_ms(&start);
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static bool try_split(int max_rank, int min_left, double* best) {
+    double t = time_program11(max_rank, min_left);
+    if (t < 0) return false;
+    printf("  split_max_rank=%-2d split_min_left=%-2d %8.1f ms\n", max_rank, min_left, t);
+    if (*best > 0 && !keep(t, *best)) return false;
+    *best = t;
+    engine_tuning.split_max_rank = max_rank;
+    engine_tuning.split_min_left = min_left;
+    return true;
+}
+
+static void tune_split(void) {
+    static const int ranks[] = {5, 7, 9, 13, 14};
+    static const int lefts[] = {2, 3, 5, 6, 8};
+    double best = 0;
+    if (!try_split(engine_tuning.split_max_rank, engine_tuning.split_min_left, &best)) {
+        printf("  program11 が実行できないので省略\n");
+        return;
+    }
+    for (size_t i = 0; i < sizeof(ranks) / sizeof(ranks[0]); i++) {
+        try_split(ranks[i], engine_tuning.split_min_left, &best);
+    }
+    for (size_t i = 0; i < sizeof(lefts) / sizeof(lefts[0]); i++) {
+        try_split(engine_tuning.split_max_rank, lefts[i], &best);
+    }
+}
+
+int autotune_main(int argc, char** argv) {
+    const char* path = engine_tune_path();
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--out=", 6) == 0) {
+            path = argv[i] + 6;
+        } else {
+            fprintf(stderr, "自動調整:\n");
+            fprintf(stderr, "Usage: %s [--out=FILE]  (既定: %s)\n", argv[0], path);
+            return 1;
+        }
+    }
+    if (!*path) {
+        fprintf(stderr, "SOSU_TUNE が空なので書き込み先がありません (--out=FILE)\n");
+        return 1;
+    }
+
+    // Measure from the defaults, not from whatever profile is loaded
+    engine_tuning = engine_tuning_default;
+    uint64_t rng = 0x5EED5EED5EEDULL;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    printf("素数判定の同時レーン数 (%s):\n", engine_kernel());
+    tune_lanes(&rng);
+    printf("固定長エンジンの上限:\n");
+    tune_limbs(&rng);
+    printf("program.c のふるいの深さ:\n");
+    tune_sieve(&rng);
+    printf("program11 の分割の深さ (%d threads):\n", threads);
+    if (threads > 1) {
+        tune_split();
+    } else {
+        // With one worker nothing is ever handed off
+        printf("  1 CPU なので省略\n");
+    }
+
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    char comment[512];
+    snprintf(comment, sizeof(comment), "sosu autotune: %s, %s, %d threads", host, engine_kernel(), threads);
+    if (!engine_tune_save(path, &engine_tuning, comment)) {
+        perror(path);
+        return 1;
+    }
+    printf("mr_lanes=%d limbs_max=%d sieve_limit=%d split_max_rank=%d split_min_left=%d\n",
+           engine_tuning.mr_lanes, engine_tuning.limbs_max, engine_tuning.sieve_limit,
+           engine_tuning.split_max_rank, engine_tuning.split_min_left);
+    printf("%s に書き込みました (%.1f s)\n", path, elapsed_ms(&start) / 1e3);
+    return 0;
+}
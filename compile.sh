@@ -1,7 +1,23 @@
-gcc program.c -o program -lgmp
-gcc program2.c -o program2 -lgmp
-gcc program3.c -o program3 -lgmp
-gcc program4.c -o program4 -lgmp
-gcc program5.c -o program5 -lgmp
-gcc program6.c -o program6 -lgmp
-gcc program7.c -o program7 -lgmp
+CFLAGS="-O2"
+gcc $CFLAGS program.c engine.c engine_limbs.c engine_tune.c output.c -o program -lgmp -pthread
+gcc $CFLAGS program2.c engine_limbs.c engine_tune.c -o program2 -lgmp
+gcc $CFLAGS program3.c engine.c output.c deadline.c engine_tune.c -o program3 -lgmp
+gcc $CFLAGS program4.c engine.c output.c deadline.c engine_tune.c -o program4 -lgmp
+gcc $CFLAGS program5.c engine.c output.c engine_tune.c -o program5 -lgmp
+gcc $CFLAGS program6.c engine.c output.c deadline.c engine_tune.c -o program6 -lgmp
+gcc $CFLAGS program7.c engine.c output.c deadline.c engine_tune.c -o program7 -lgmp -lm -pthread
+gcc $CFLAGS program8.c engine.c engine_tune.c -o program8 -lgmp
+gcc $CFLAGS program9.c engine.c engine_tune.c -o program9 -lgmp -pthread
+gcc $CFLAGS program10.c engine.c engine_tune.c -o program10 -lgmp
+gcc $CFLAGS program11.c engine.c engine_tune.c -o program11 -lgmp -pthread
+gcc $CFLAGS program12.c engine.c engine_tune.c -o program12 -lgmp -pthread
+gcc $CFLAGS program13.c engine.c engine_limbs.c engine_tune.c -o program13 -lgmp
+gcc $CFLAGS program14.c engine.c engine_tune.c -o program14 -lgmp -lm -pthread
+
+# sosu: every tool as a subcommand of one binary (./sosu program7 ...)
+for p in program program2 program3 program4 program5 program6 program7 program8 program9 program10 program11 program12 program13 program14; do
+    gcc $CFLAGS -Dmain=${p}_main -c $p.c -o $p.o
+    objcopy --keep-global-symbol=${p}_main $p.o
+done
+gcc $CFLAGS sosu.c autotune.c engine.c engine_limbs.c engine_tune.c output.c deadline.c program*.o -o sosu -lgmp -lm -pthread
+rm -f program*.o
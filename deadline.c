@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "engine.h"
+#include "output.h"
+#include "deadline.h"
+
+// Deadline mode: instead of n random draws, walk the arrangement space in
+// value order (most cards first, then largest leading card) and stop when
+// the clock runs out, keeping whatever primes were found by then
+#define MAX_DEADLINE_CARDS 19  // 19 digits always fit in unsigned long long
+#define CLOCK_CHECK_NODES 4096  // DFS calls between clock reads
+
+typedef struct {
+    unsigned long long num;
+    int elements_size;
+    int elements[MAX_DEADLINE_CARDS];
+} DeadlineHit;
+
+typedef struct {
+    int counts[14];
+    int target;                  // cards per arrangement in the current pass
+    int seq[MAX_DEADLINE_CARDS];
+    unsigned long long batch_nums[PRIME_BATCH];
+    int batch_seqs[PRIME_BATCH][MAX_DEADLINE_CARDS];
+    int batch_count;
+    DeadlineHit* hits;
+    size_t hit_count, hit_capacity;
+    unsigned long long tested, limit;
+    long long deadline;
+    unsigned long long nodes;
+    int short_cards;             // one-digit cards (0..9) left in counts
+    bool expired;
+} DeadlineSearch;
+
+// Rank counts of a hand, with the same card letters as generate()
+static int parse_hand(const char* text, int* counts) {
+    int size = 0;
+    for (const char* p = text; *p != '\0'; p++) {
+        int value = *p == 'O' ? rand() % 14 : parse_card(*p);
+        if (value >= 0) {
+            counts[value]++;
+            size++;
+        }
+    }
+    return size;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Number of distinct arrangements of k_min..k_max cards within the digit
+// limit: sum over sub-multisets of k!/prod(c!)
+static double count_arrangements(const int* counts, int k_min, int k_max) {
+    double w[MAX_DEADLINE_CARDS + 1][MAX_DEADLINE_CARDS + 1] = {{0}};
+    w[0][0] = 1;
+    for (int r = 0; r < 14; r++) {
+        int len = r >= 10 ? 2 : 1;
+        double next[MAX_DEADLINE_CARDS + 1][MAX_DEADLINE_CARDS + 1] = {{0}};
+        for (int k = 0; k <= MAX_DEADLINE_CARDS; k++) {
+            for (int d = 0; d <= MAX_DEADLINE_CARDS; d++) {
+                if (w[k][d] == 0) continue;
+                double inv_fact = 1;
+                for (int c = 0; c <= counts[r] && k + c <= MAX_DEADLINE_CARDS && d + c * len <= MAX_DEADLINE_CARDS; c++) {
+                    if (c > 0) inv_fact /= c;
+                    next[k + c][d + c * len] += w[k][d] * inv_fact;
+                }
+            }
+        }
+        memcpy(w, next, sizeof(w));
+    }
+
+    double total = 0, fact = 1;
+    for (int k = 1; k <= MAX_DEADLINE_CARDS; k++) {
+        fact *= k;
+        if (k < k_min || k > k_max) continue;
+        for (int d = 0; d <= MAX_DEADLINE_CARDS; d++) total += fact * w[k][d];
+    }
+    return total;
+}
+
+static void deadline_flush(DeadlineSearch* ds) {
+    bool prime[PRIME_BATCH];
+    is_prime_batch(ds->batch_nums, ds->batch_count, prime);
+    for (int b = 0; b < ds->batch_count; b++) {
+        if (!prime[b]) continue;
+        if (ds->hit_count == ds->hit_capacity) {
+            ds->hit_capacity = ds->hit_capacity ? ds->hit_capacity * 2 : 256;
+            ds->hits = realloc(ds->hits, ds->hit_capacity * sizeof(DeadlineHit));
+        }
+        DeadlineHit* hit = &ds->hits[ds->hit_count++];
+        hit->num = ds->batch_nums[b];
+        hit->elements_size = ds->target;
+        memcpy(hit->elements, ds->batch_seqs[b], ds->target * sizeof(int));
+    }
+    ds->tested += ds->batch_count;
+    ds->batch_count = 0;
+    if (ds->limit > 0 && ds->tested >= ds->limit) ds->expired = true;
+}
+
+// Fewest digits `cards` more cards can take: one-digit cards first
+static int min_digits(int short_cards, int cards) {
+    return cards <= short_cards ? cards : 2 * cards - short_cards;
+}
+
+// Distinct arrangements of ds->target cards, largest rank first at every
+// position. The clock is read by node count, not by batch: subtrees that
+// cannot reach target cards make no candidates but still take time.
+static void deadline_dfs(DeadlineSearch* ds, int depth, unsigned long long value, int digits) {
+    if (ds->expired) return;
+    if (++ds->nodes % CLOCK_CHECK_NODES == 0 && now_ms() >= ds->deadline) {
+        ds->expired = true;
+        return;
+    }
+    if (depth == ds->target) {
+        ds->batch_nums[ds->batch_count] = value;
+        memcpy(ds->batch_seqs[ds->batch_count], ds->seq, depth * sizeof(int));
+        if (++ds->batch_count == PRIME_BATCH) deadline_flush(ds);
+        return;
+    }
+    for (int r = 13; r >= 0; r--) {
+        if (ds->counts[r] == 0) continue;
+        int len = r >= 10 ? 2 : 1;
+        ds->short_cards -= len == 1;
+        // The rest of the arrangement has to fit in the digit limit too
+        if (digits + len + min_digits(ds->short_cards, ds->target - depth - 1) <= MAX_DEADLINE_CARDS) {
+            ds->counts[r]--;
+            ds->seq[depth] = r;
+            deadline_dfs(ds, depth + 1, value * (len == 2 ? 100 : 10) + r, digits + len);
+            ds->counts[r]++;
+        }
+        ds->short_cards += len == 1;
+        if (ds->expired) return;
+    }
+}
+
+static int compare_deadline_hits(const void* a, const void* b) {
+    const DeadlineHit* pa = (const DeadlineHit*)a;
+    const DeadlineHit* pb = (const DeadlineHit*)b;
+    if (pa->num < pb->num) return -1;
+    if (pa->num > pb->num) return 1;
+    return 0;
+}
+
+void run_deadline(Output* out, const char* text, long deadline_ms, unsigned long long limit, bool full_hand) {
+    long long start = now_ms();
+    DeadlineSearch ds;
+    memset(&ds, 0, sizeof(ds));
+    ds.deadline = start + deadline_ms;
+    ds.limit = limit;
+
+    int hand_size = parse_hand(text, ds.counts);
+    for (int r = 0; r < 10; r++) ds.short_cards += ds.counts[r];
+
+    int k_max = hand_size < MAX_DEADLINE_CARDS ? hand_size : MAX_DEADLINE_CARDS;
+    int k_min = full_hand ? hand_size : 1;
+    double space = count_arrangements(ds.counts, k_min, k_max);
+
+    for (ds.target = k_max; ds.target >= k_min && !ds.expired; ds.target--) {
+        // Even the shortest cards would not fit: no arrangement of this size
+        if (min_digits(ds.short_cards, ds.target) > MAX_DEADLINE_CARDS) continue;
+        deadline_dfs(&ds, 0, 0, 0);
+        if (ds.batch_count > 0) deadline_flush(&ds);
+    }
+
+    qsort(ds.hits, ds.hit_count, sizeof(DeadlineHit), compare_deadline_hits);
+    if (out->format == FORMAT_TEXT) out_str(out, "Best primes:\n");
+    for (size_t i = 0; i < ds.hit_count; i++) {
+        if (i > 0 && ds.hits[i].num == ds.hits[i - 1].num) continue;
+        out_hit(out, ds.hits[i].elements, ds.hits[i].elements_size, ds.hits[i].num);
+    }
+    out_flush(out);
+    fprintf(stderr, "covered %llu of %.0f arrangements (%.2f%%) in %lld ms\n",
+            ds.tested, space, space > 0 ? 100.0 * ds.tested / space : 100.0, now_ms() - start);
+    free(ds.hits);
+}
@@ -0,0 +1,15 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <stdbool.h>
+
+#include "output.h"
+
+// Anytime search for program3/4/6/7 (--deadline-ms=T): runs until
+// deadline_ms elapses (or limit candidates, if > 0) and prints the primes
+// found, largest last, plus the share of the space covered on stderr.
+// full_hand only counts arrangements of every card. Jokers are fixed to one
+// random rank for the whole run.
+void run_deadline(Output* out, const char* text, long deadline_ms, unsigned long long limit, bool full_hand);
+
+#endif
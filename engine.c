@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "engine.h"
+#include "engine_tune.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define ENGINE_X86 1
+#include <immintrin.h>
+#endif
+
+// Deterministic bases, sufficient for every n < 2^64
+static const unsigned long long mr_bases[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+#define MR_BASE_COUNT (int)(sizeof(mr_bases) / sizeof(mr_bases[0]))
+
+// Candidates this wide or narrower fit the 52-bit IFMA lanes
+#define IFMA_BITS 52
+
+static int bit_length(unsigned long long x) {
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+// Batched Miller-Rabin: up to MR_LANES candidates advance through their
+// modular exponentiations in lockstep so the independent Montgomery
+// multiplications overlap in the pipeline instead of waiting on one chain.
+// Runs the full base set on `count` (<= MR_LANES) odd candidates > 3.
+static inline __attribute__((always_inline)) void mr_lanes_body(const unsigned long long* nums, int count, bool* out) {
+    unsigned long long n[MR_LANES], ninv[MR_LANES], one[MR_LANES], mone[MR_LANES];
+    unsigned long long r2[MR_LANES], d[MR_LANES], x[MR_LANES], base[MR_LANES];
+    int s[MR_LANES];
+    int max_bits = 0;
+
+    for (int l = 0; l < count; l++) {
+        n[l] = nums[l];
+        ninv[l] = mont_inverse(n[l]);
+        one[l] = (unsigned long long)((((unsigned __int128)1) << 64) % n[l]);
+        mone[l] = n[l] - one[l];
+        r2[l] = (unsigned long long)(((unsigned __int128)one[l] << 64) % n[l]);
+        d[l] = n[l] - 1;
+        s[l] = __builtin_ctzll(d[l]);
+        d[l] >>= s[l];
+        out[l] = true;
+        if (bit_length(d[l]) > max_bits) max_bits = bit_length(d[l]);
+    }
+
+    for (int b = 0; b < MR_BASE_COUNT; b++) {
+        for (int l = 0; l < count; l++) {
+            unsigned long long a = mr_bases[b] % n[l];
+            base[l] = a ? mont_mul(a, r2[l], n[l], ninv[l]) : 0;
+            x[l] = one[l];
+        }
+
+        // Lockstep square-and-multiply; the multiply is branchless so every
+        // lane issues the same instruction stream
+        for (int bit = max_bits - 1; bit >= 0; bit--) {
+            for (int l = 0; l < count; l++) {
+                x[l] = mont_mul(x[l], x[l], n[l], ninv[l]);
+                unsigned long long m = ((d[l] >> bit) & 1) ? base[l] : one[l];
+                x[l] = mont_mul(x[l], m, n[l], ninv[l]);
+            }
+        }
+
+        for (int l = 0; l < count; l++) {
+            if (!out[l] || base[l] == 0) continue;
+            if (x[l] == one[l] || x[l] == mone[l]) continue;
+            int j;
+            for (j = 0; j < s[l] - 1; j++) {
+                x[l] = mont_mul(x[l], x[l], n[l], ninv[l]);
+                if (x[l] == mone[l]) break;
+            }
+            if (j == s[l] - 1) out[l] = false;
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) bool is_prime_body(unsigned long long n) {
+    if (n < 2) return false;
+    if (n < 4) return true;
+    if (n % 2 == 0) return false;
+
+    unsigned long long ninv = mont_inverse(n);
+    unsigned long long one = (unsigned long long)((((unsigned __int128)1) << 64) % n);
+    unsigned long long mone = n - one;
+    unsigned long long r2 = (unsigned long long)(((unsigned __int128)one << 64) % n);
+    unsigned long long d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+
+    for (int b = 0; b < MR_BASE_COUNT; b++) {
+        unsigned long long a = mr_bases[b] % n;
+        if (a == 0) continue;
+        unsigned long long base = mont_mul(a, r2, n, ninv);
+        unsigned long long x = one;
+        for (int bit = 63 - __builtin_clzll(d); bit >= 0; bit--) {
+            x = mont_mul(x, x, n, ninv);
+            if ((d >> bit) & 1) x = mont_mul(x, base, n, ninv);
+        }
+        if (x == one || x == mone) continue;
+        int j;
+        for (j = 0; j < s - 1; j++) {
+            x = mont_mul(x, x, n, ninv);
+            if (x == mone) break;
+        }
+        if (j == s - 1) return false;
+    }
+    return true;
+}
+
+typedef void LaneKernel(const unsigned long long* nums, int count, bool* out);
+typedef bool PrimeKernel(unsigned long long n);
+
+static void mr_lanes_generic(const unsigned long long* nums, int count, bool* out) {
+    mr_lanes_body(nums, count, out);
+}
+
+static bool is_prime_generic(unsigned long long n) {
+    return is_prime_body(n);
+}
+
+#ifdef ENGINE_X86
+// Same code with BMI2/ADX enabled: the 64x64->128 products become mulx
+// and the carry chains adcx/adox
+__attribute__((target("bmi2,adx,avx2")))
+static void mr_lanes_bmi2(const unsigned long long* nums, int count, bool* out) {
+    mr_lanes_body(nums, count, out);
+}
+
+__attribute__((target("bmi2,adx,avx2")))
+static bool is_prime_bmi2(unsigned long long n) {
+    return is_prime_body(n);
+}
+
+// AVX-512 IFMA: eight lanes of 52-bit Montgomery arithmetic (R = 2^52) in
+// one zmm register each, for chunks whose candidates are all below 2^52.
+// vpmadd52luq/huq give the low and high 52 bits of a 52x52 product.
+#define IFMA_MASK ((1ULL << IFMA_BITS) - 1)
+
+__attribute__((target("avx512f,avx512ifma")))
+static inline __m512i ifma_mont_mul(__m512i a, __m512i b, __m512i n, __m512i nprime) {
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i lo = _mm512_madd52lo_epu64(zero, a, b);
+    __m512i hi = _mm512_madd52hi_epu64(zero, a, b);
+    __m512i m = _mm512_madd52lo_epu64(zero, lo, nprime);
+    // lo + low52(m*n) is 0 or exactly 2^52; it carries unless lo == 0
+    hi = _mm512_madd52hi_epu64(hi, m, n);
+    hi = _mm512_mask_add_epi64(hi, _mm512_cmpneq_epu64_mask(lo, zero), hi, _mm512_set1_epi64(1));
+    return _mm512_mask_sub_epi64(hi, _mm512_cmpge_epu64_mask(hi, n), hi, n);
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+static void mr_lanes_ifma(const unsigned long long* nums, int count, bool* out) {
+    unsigned long long n[MR_LANES], nprime[MR_LANES], one[MR_LANES], r2[MR_LANES], d[MR_LANES], s[MR_LANES];
+    int max_bits = 0, max_s = 0;
+    for (int l = 0; l < MR_LANES; l++) {
+        // Idle lanes run on a harmless modulus and are ignored
+        n[l] = l < count ? nums[l] : 5;
+        nprime[l] = (0 - mont_inverse(n[l])) & IFMA_MASK;
+        one[l] = (1ULL << IFMA_BITS) % n[l];
+        r2[l] = (unsigned long long)((((unsigned __int128)1) << (2 * IFMA_BITS)) % n[l]);
+        d[l] = n[l] - 1;
+        s[l] = __builtin_ctzll(d[l]);
+        d[l] >>= s[l];
+        if (bit_length(d[l]) > max_bits) max_bits = bit_length(d[l]);
+        if ((int)s[l] > max_s) max_s = s[l];
+    }
+
+    __m512i vn = _mm512_loadu_si512(n), vnp = _mm512_loadu_si512(nprime);
+    __m512i vone = _mm512_loadu_si512(one), vr2 = _mm512_loadu_si512(r2);
+    __m512i vd = _mm512_loadu_si512(d), vs = _mm512_loadu_si512(s);
+    __m512i vmone = _mm512_sub_epi64(vn, vone);
+    __mmask8 prime = (__mmask8)((1u << count) - 1);
+
+    for (int b = 0; b < MR_BASE_COUNT; b++) {
+        unsigned long long a[MR_LANES];
+        for (int l = 0; l < MR_LANES; l++) a[l] = mr_bases[b] % n[l];
+        __m512i va = _mm512_loadu_si512(a);
+        __mmask8 skip = _mm512_cmpeq_epu64_mask(va, _mm512_setzero_si512());
+        __m512i base = ifma_mont_mul(va, vr2, vn, vnp);
+        __m512i x = vone;
+
+        for (int bit = max_bits - 1; bit >= 0; bit--) {
+            x = ifma_mont_mul(x, x, vn, vnp);
+            __mmask8 set = _mm512_test_epi64_mask(vd, _mm512_set1_epi64(1ULL << bit));
+            x = ifma_mont_mul(x, _mm512_mask_blend_epi64(set, vone, base), vn, vnp);
+        }
+
+        // A lane passes on x = +-1, or on reaching -1 within s-1 squarings
+        __mmask8 pass = skip | _mm512_cmpeq_epu64_mask(x, vone) | _mm512_cmpeq_epu64_mask(x, vmone);
+        for (int j = 0; j < max_s - 1; j++) {
+            x = ifma_mont_mul(x, x, vn, vnp);
+            __mmask8 in_range = _mm512_cmpgt_epu64_mask(vs, _mm512_set1_epi64(j + 1));
+            pass |= in_range & _mm512_cmpeq_epu64_mask(x, vmone);
+        }
+        prime &= pass;
+    }
+
+    for (int l = 0; l < count; l++) out[l] = (prime >> l) & 1;
+}
+
+static LaneKernel* resolve_wide_lanes(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2") ? mr_lanes_bmi2 : mr_lanes_generic;
+}
+
+static LaneKernel* resolve_narrow_lanes(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512ifma")) return mr_lanes_ifma;
+    return resolve_wide_lanes();
+}
+
+static PrimeKernel* resolve_is_prime(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2") ? is_prime_bmi2 : is_prime_generic;
+}
+
+// Picked once by the dynamic loader from cpuid; no per-call dispatch cost
+static void mr_lanes_wide(const unsigned long long* nums, int count, bool* out)
+    __attribute__((ifunc("resolve_wide_lanes")));
+static void mr_lanes_narrow(const unsigned long long* nums, int count, bool* out)
+    __attribute__((ifunc("resolve_narrow_lanes")));
+bool is_prime(unsigned long long n) __attribute__((ifunc("resolve_is_prime")));
+
+const char* engine_kernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512ifma")) return "avx512ifma (<2^52) + bmi2";
+    if (__builtin_cpu_supports("bmi2")) return "bmi2";
+    return "generic";
+}
+#else
+#define mr_lanes_wide mr_lanes_generic
+#define mr_lanes_narrow mr_lanes_generic
+
+bool is_prime(unsigned long long n) {
+    return is_prime_generic(n);
+}
+
+const char* engine_kernel(void) {
+    return "generic";
+}
+#endif
+
+void is_prime_batch(const unsigned long long* nums, int count, bool* out) {
+    int order[count];
+    int pending = 0;
+
+    for (int i = 0; i < count; i++) {
+        unsigned long long v = nums[i];
+        if (v <= 3) {
+            out[i] = v >= 2;
+        } else if (v % 2 == 0) {
+            out[i] = false;
+        } else {
+            order[pending++] = i;
+        }
+    }
+
+    // Group by bit length so lanes in a chunk run chains of equal length
+    for (int i = 1; i < pending; i++) {
+        int key = order[i];
+        int j = i - 1;
+        while (j >= 0 && bit_length(nums[order[j]]) > bit_length(nums[key])) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = key;
+    }
+
+    // Chunk width from the host profile: fewer lanes can win where the
+    // Montgomery chains spill registers
+    int width = engine_tuning.mr_lanes;
+    for (int i = 0; i < pending; i += width) {
+        int lanes = (pending - i < width) ? pending - i : width;
+        unsigned long long lane_nums[MR_LANES];
+        bool lane_out[MR_LANES];
+        for (int l = 0; l < lanes; l++) lane_nums[l] = nums[order[i + l]];
+        // Sorted by size, so the last lane is the widest
+        if (bit_length(lane_nums[lanes - 1]) <= IFMA_BITS) {
+            mr_lanes_narrow(lane_nums, lanes, lane_out);
+        } else {
+            mr_lanes_wide(lane_nums, lanes, lane_out);
+        }
+        for (int l = 0; l < lanes; l++) out[order[i + l]] = lane_out[l];
+    }
+}
+
+int parse_card(char c) {
+    switch (c) {
+        case 'A': return 1;
+        case '2': return 2;
+        case '3': return 3;
+        case '4': return 4;
+        case '5': return 5;
+        case '6': return 6;
+        case '7': return 7;
+        case '8': return 8;
+        case '9': return 9;
+        case 'T': return 10;
+        case 'J': return 11;
+        case 'Q': return 12;
+        case 'K': return 13;
+        default: return -1;
+    }
+}
+
+int scaledrand(int x) {
+    if (x == 0) return 0;
+    int a = rand() % (x + 1);
+    int b = rand() % x;
+    return a > b ? a : b;
+}
+
+uint32_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 2685821657736338717ULL) >> 32);
+}
+
+uint64_t splitmix(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+int scaledrand_r(int x, uint64_t* rng) {
+    if (x == 0) return 0;
+    int a = next_random(rng) % (x + 1);
+    int b = next_random(rng) % x;
+    return a > b ? a : b;
+}
+
+void generate(const char* text, bool full_hand, int** elements_ptr, int* elements_size) {
+    int counts[14] = {0};
+    for (const char* p = text; *p != '\0'; p++) {
+        int value = *p == 'O' ? rand() % 14 : parse_card(*p);
+        if (value >= 0) counts[value]++;
+    }
+
+    int* elements = NULL;
+    size_t capacity = 0;
+    size_t size = 0;
+    for (int i = 0; i < 14; i++) {
+        if (counts[i] == 0) continue;
+        int s = full_hand ? counts[i] : scaledrand(counts[i]);
+        for (int j = 0; j < s; j++) {
+            if (size >= capacity) {
+                capacity = (capacity == 0) ? 1 : capacity * 2;
+                elements = realloc(elements, capacity * sizeof(int));
+            }
+            elements[size++] = i;
+        }
+    }
+
+    // Fisher-Yates shuffle; an empty play has nothing to shuffle
+    for (size_t i = 0; i + 1 < size; i++) {
+        size_t j = i + rand() % (size - i);
+        int temp = elements[j];
+        elements[j] = elements[i];
+        elements[i] = temp;
+    }
+
+    *elements_ptr = elements;
+    *elements_size = size;
+}
+
+unsigned long long cards_value(const int* cards, int size) {
+    unsigned long long num = 0;
+    for (int i = 0; i < size; i++) {
+        if (__builtin_mul_overflow(num, cards[i] >= 10 ? 100 : 10, &num) ||
+            __builtin_add_overflow(num, cards[i], &num)) return ULLONG_MAX;
+    }
+    return num;
+}
+
+void print_key(uint64_t key) {
+    const char* names = "0A23456789TJQK";
+    for (int r = 13; r >= 0; r--) {
+        for (int c = 0; c < KEY_COUNT(key, r); c++) putchar(names[r]);
+    }
+}
+
+double elapsed_ms(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
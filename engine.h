@@ -0,0 +1,74 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Shared prime engine for the card tools. The hot kernels are compiled
+// several times and the fastest one for the host CPU is picked once at
+// load time (see engine.c).
+
+#define MR_LANES 8
+#define PRIME_BATCH 64
+
+// n^-1 mod 2^64 for odd n (Newton iteration)
+static inline unsigned long long mont_inverse(unsigned long long n) {
+    unsigned long long x = n;
+    for (int i = 0; i < 5; i++) x *= 2 - n * x;
+    return x;
+}
+
+// a*b*2^-64 mod n, valid for any odd n < 2^64
+static inline unsigned long long mont_mul(unsigned long long a, unsigned long long b,
+                                          unsigned long long n, unsigned long long ninv) {
+    unsigned __int128 t = (unsigned __int128)a * b;
+    unsigned long long m = (unsigned long long)t * ninv;
+    unsigned long long hi = (unsigned long long)(t >> 64);
+    unsigned long long mn = (unsigned long long)(((unsigned __int128)m * n) >> 64);
+    unsigned long long r = hi - mn;
+    return hi < mn ? r + n : r;
+}
+
+// Deterministic Miller-Rabin for all n < 2^64
+bool is_prime(unsigned long long n);
+
+// Tests `count` candidates at once; results land in out[i] for nums[i]
+void is_prime_batch(const unsigned long long* nums, int count, bool* out);
+
+// Names the kernels selected for this CPU
+const char* engine_kernel(void);
+
+// A..K -> 1..13; jokers and anything else -> -1
+int parse_card(char c);
+
+// How many copies of a rank to play: the larger of two uniform draws
+int scaledrand(int x);
+
+// xorshift64* for callers that need their own stream (one per thread)
+uint32_t next_random(uint64_t* state);
+
+// SplitMix64 step: seeds and hashes, not a stream for sampling
+uint64_t splitmix(uint64_t* state);
+int scaledrand_r(int x, uint64_t* rng);
+
+// Random play from a hand string: a scaledrand() number of copies of each
+// rank (every copy with full_hand) in random order. Each joker O becomes a
+// random rank 0..13. *elements_ptr is malloc'd.
+void generate(const char* text, bool full_hand, int** elements_ptr, int* elements_size);
+
+// The cards' concatenated decimal value, saturating at ULLONG_MAX like
+// strtoull on the concatenated string
+unsigned long long cards_value(const int* cards, int size);
+
+// Hand keys: 4 bits of copy count per rank 0..13 (and up to 15 copies)
+#define KEY_COUNT(key, r) ((int)(((key) >> (4 * (r))) & 15))
+#define KEY_ONE(r) (1ULL << (4 * (r)))
+
+// The key's cards, largest rank first, on stdout
+void print_key(uint64_t key);
+
+// Milliseconds since *start (CLOCK_MONOTONIC)
+double elapsed_ms(const struct timespec* start);
+
+#endif
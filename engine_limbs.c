@@ -0,0 +1,412 @@
+#include <string.h>
+#include "engine.h"
+#include "engine_limbs.h"
+
+#if GMP_NUMB_BITS != 64
+#error "engine_limbs expects 64-bit limbs without nails"
+#endif
+
+typedef unsigned __int128 u128;
+
+// Residues are kept in [0, n) and in Montgomery form (x*R mod n, R = 2^(64N))
+typedef struct {
+    uint64_t n[LIMBS_MAX];
+    uint64_t ninv;              // -n^-1 mod 2^64
+    uint64_t one[LIMBS_MAX];    // R mod n
+    uint64_t mone[LIMBS_MAX];   // -R mod n
+    uint64_t r2[LIMBS_MAX];     // R^2 mod n
+} MontCtx;
+
+// The helpers below are always inlined into bodies that the wrappers call
+// with a constant N, so every loop is unrolled per limb count
+#define LIMBS_INLINE static inline __attribute__((always_inline))
+#define UNROLL_LIMBS _Pragma("GCC unroll 10")  // 2 * LIMBS_MAX
+
+// r = t - n if t (with carry `top`) >= n, else t
+LIMBS_INLINE void sub_if_ge(uint64_t* r, const uint64_t* t, uint64_t top, const uint64_t* n, int N) {
+    uint64_t d[LIMBS_MAX];
+    uint64_t borrow = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) {
+        u128 diff = (u128)t[j] - n[j] - borrow;
+        d[j] = (uint64_t)diff;
+        borrow = (uint64_t)(diff >> 64) & 1;
+    }
+    bool ge = top || !borrow;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) r[j] = ge ? d[j] : t[j];
+}
+
+// CIOS Montgomery multiplication: r = a*b/R mod n; r may alias a or b
+LIMBS_INLINE void mont_mul_n(uint64_t* r, const uint64_t* a, const uint64_t* b, const MontCtx* c, int N) {
+    uint64_t t[LIMBS_MAX + 2] = {0};
+    UNROLL_LIMBS
+    for (int i = 0; i < N; i++) {
+        u128 acc = 0;
+        UNROLL_LIMBS
+        for (int j = 0; j < N; j++) {
+            acc = (u128)a[j] * b[i] + t[j] + (uint64_t)(acc >> 64);
+            t[j] = (uint64_t)acc;
+        }
+        acc = (u128)t[N] + (uint64_t)(acc >> 64);
+        t[N] = (uint64_t)acc;
+        t[N + 1] = (uint64_t)(acc >> 64);
+
+        uint64_t m = t[0] * c->ninv;
+        acc = (u128)m * c->n[0] + t[0];
+        UNROLL_LIMBS
+        for (int j = 1; j < N; j++) {
+            acc = (u128)m * c->n[j] + t[j] + (uint64_t)(acc >> 64);
+            t[j - 1] = (uint64_t)acc;
+        }
+        acc = (u128)t[N] + (uint64_t)(acc >> 64);
+        t[N - 1] = (uint64_t)acc;
+        t[N] = t[N + 1] + (uint64_t)(acc >> 64);
+    }
+    // t < 2n here
+    sub_if_ge(r, t, t[N], c->n, N);
+}
+
+// Montgomery reduction of a 2N-limb product: r = t/R mod n
+LIMBS_INLINE void mont_redc_n(uint64_t* r, uint64_t* t, const MontCtx* c, int N) {
+    uint64_t top = 0;
+    UNROLL_LIMBS
+    for (int i = 0; i < N; i++) {
+        uint64_t m = t[i] * c->ninv;
+        u128 acc = 0;
+        UNROLL_LIMBS
+        for (int j = 0; j < N; j++) {
+            acc = (u128)m * c->n[j] + t[i + j] + (uint64_t)(acc >> 64);
+            t[i + j] = (uint64_t)acc;
+        }
+        acc = (u128)t[i + N] + (uint64_t)(acc >> 64) + top;
+        t[i + N] = (uint64_t)acc;
+        top = (uint64_t)(acc >> 64);
+    }
+    sub_if_ge(r, t + N, top, c->n, N);
+}
+
+// r = a^2/R mod n: each cross product is computed once and doubled
+LIMBS_INLINE void mont_sqr_n(uint64_t* r, const uint64_t* a, const MontCtx* c, int N) {
+    // At five limbs this form runs out of registers and loses to a plain
+    // multiply
+    if (N >= 5) {
+        mont_mul_n(r, a, a, c, N);
+        return;
+    }
+    uint64_t t[2 * LIMBS_MAX] = {0};
+    UNROLL_LIMBS
+    for (int i = 0; i < N - 1; i++) {
+        u128 acc = 0;
+        UNROLL_LIMBS
+        for (int j = i + 1; j < N; j++) {
+            acc = (u128)a[i] * a[j] + t[i + j] + (uint64_t)(acc >> 64);
+            t[i + j] = (uint64_t)acc;
+        }
+        t[i + N] = (uint64_t)(acc >> 64);
+    }
+    uint64_t carry = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < 2 * N; j++) {
+        uint64_t next = t[j] >> 63;
+        t[j] = (t[j] << 1) | carry;
+        carry = next;
+    }
+    u128 acc = 0;
+    UNROLL_LIMBS
+    for (int i = 0; i < N; i++) {
+        u128 sq = (u128)a[i] * a[i];
+        acc = (u128)t[2 * i] + (uint64_t)sq + (uint64_t)(acc >> 64);
+        t[2 * i] = (uint64_t)acc;
+        acc = (u128)t[2 * i + 1] + (uint64_t)(sq >> 64) + (uint64_t)(acc >> 64);
+        t[2 * i + 1] = (uint64_t)acc;
+    }
+    mont_redc_n(r, t, c, N);
+}
+
+LIMBS_INLINE void mont_add_n(uint64_t* r, const uint64_t* a, const uint64_t* b, const MontCtx* c, int N) {
+    uint64_t t[LIMBS_MAX];
+    uint64_t carry = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) {
+        u128 sum = (u128)a[j] + b[j] + carry;
+        t[j] = (uint64_t)sum;
+        carry = (uint64_t)(sum >> 64);
+    }
+    sub_if_ge(r, t, carry, c->n, N);
+}
+
+LIMBS_INLINE void mont_sub_n(uint64_t* r, const uint64_t* a, const uint64_t* b, const MontCtx* c, int N) {
+    uint64_t t[LIMBS_MAX];
+    uint64_t borrow = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) {
+        u128 diff = (u128)a[j] - b[j] - borrow;
+        t[j] = (uint64_t)diff;
+        borrow = (uint64_t)(diff >> 64) & 1;
+    }
+    uint64_t mask = 0 - borrow, carry = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) {
+        u128 sum = (u128)t[j] + (c->n[j] & mask) + carry;
+        r[j] = (uint64_t)sum;
+        carry = (uint64_t)(sum >> 64);
+    }
+}
+
+// r = a/2 mod n; halving commutes with the Montgomery factor
+LIMBS_INLINE void mont_half_n(uint64_t* r, const uint64_t* a, const MontCtx* c, int N) {
+    uint64_t t[LIMBS_MAX];
+    uint64_t mask = 0 - (a[0] & 1), carry = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) {
+        u128 sum = (u128)a[j] + (c->n[j] & mask) + carry;
+        t[j] = (uint64_t)sum;
+        carry = (uint64_t)(sum >> 64);
+    }
+    UNROLL_LIMBS
+    for (int j = 0; j < N - 1; j++) r[j] = (t[j] >> 1) | (t[j + 1] << 63);
+    r[N - 1] = (t[N - 1] >> 1) | (carry << 63);
+}
+
+LIMBS_INLINE bool limbs_equal(const uint64_t* a, const uint64_t* b, int N) {
+    uint64_t diff = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) diff |= a[j] ^ b[j];
+    return diff == 0;
+}
+
+LIMBS_INLINE bool limbs_zero(const uint64_t* a, int N) {
+    uint64_t any = 0;
+    UNROLL_LIMBS
+    for (int j = 0; j < N; j++) any |= a[j];
+    return any == 0;
+}
+
+static int limbs_bit(const uint64_t* x, int bit) {
+    return (x[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Bits lo .. lo+width-1 of x, width <= 8
+static unsigned limbs_bits(const uint64_t* x, int lo, int width) {
+    int l = lo / 64, o = lo % 64;
+    uint64_t v = x[l] >> o;
+    if (o + width > 64) v |= x[l + 1] << (64 - o);
+    return (unsigned)(v & ((1u << width) - 1));
+}
+
+static int limbs_ctz(const uint64_t* x) {
+    int l = 0;
+    while (x[l] == 0) l++;
+    return 64 * l + __builtin_ctzll(x[l]);
+}
+
+static int limbs_top_bit(const uint64_t* x, int size) {
+    int l = size - 1;
+    while (x[l] == 0) l--;
+    return 64 * l + 63 - __builtin_clzll(x[l]);
+}
+
+// Setup divides once with mpn_tdiv_qr; nothing after this touches GMP
+static void mont_init(MontCtx* c, const mpz_t n, int N) {
+    const mp_limb_t* nl = mpz_limbs_read(n);
+    mp_limb_t num[2 * LIMBS_MAX + 1] = {0};
+    mp_limb_t q[LIMBS_MAX + 2];
+    mp_limb_t rem[LIMBS_MAX];
+
+    for (int j = 0; j < N; j++) c->n[j] = nl[j];
+    c->ninv = 0 - mont_inverse(c->n[0]);
+
+    num[N] = 1;
+    mpn_tdiv_qr(q, rem, 0, num, N + 1, nl, N);
+    for (int j = 0; j < N; j++) c->one[j] = rem[j];
+    num[N] = 0;
+    num[2 * N] = 1;
+    mpn_tdiv_qr(q, rem, 0, num, 2 * N + 1, nl, N);
+    for (int j = 0; j < N; j++) c->r2[j] = rem[j];
+
+    uint64_t borrow = 0;
+    for (int j = 0; j < N; j++) {
+        u128 diff = (u128)c->n[j] - c->one[j] - borrow;
+        c->mone[j] = (uint64_t)diff;
+        borrow = (uint64_t)(diff >> 64) & 1;
+    }
+}
+
+// r = k*a mod n for a small signed k, by doubling and adding; r must not
+// alias a
+LIMBS_INLINE void mont_scale(uint64_t* r, const uint64_t* a, long k, const MontCtx* c, int N) {
+    unsigned long m = k < 0 ? 0 - (unsigned long)k : (unsigned long)k;
+    memset(r, 0, N * sizeof(uint64_t));
+    for (int bit = 63 - __builtin_clzl(m | 1); bit >= 0; bit--) {
+        mont_add_n(r, r, r, c, N);
+        if ((m >> bit) & 1) mont_add_n(r, r, a, c, N);
+    }
+    if (k < 0) {
+        uint64_t zero[LIMBS_MAX] = {0};
+        mont_sub_n(r, zero, r, c, N);
+    }
+}
+
+#define WINDOW_BITS 4
+
+LIMBS_INLINE bool sprp_body(const mpz_t n, const mpz_t a, int N) {
+    MontCtx c;
+    mont_init(&c, n, N);
+
+    uint64_t nm1[LIMBS_MAX];
+    for (int j = 0; j < N; j++) nm1[j] = c.n[j];
+    nm1[0]--;   // n is odd
+    int s = limbs_ctz(nm1);
+    int top = limbs_top_bit(nm1, N);
+
+    uint64_t x[LIMBS_MAX];
+    memcpy(x, c.one, sizeof(x));
+    if (mpz_cmp_ui(a, 2) == 0) {
+        // Base 2: the multiply by the base is a doubling
+        for (int bit = top; bit >= s; bit--) {
+            mont_sqr_n(x, x, &c, N);
+            if (limbs_bit(nm1, bit)) mont_add_n(x, x, x, &c, N);
+        }
+    } else {
+        uint64_t table[1 << WINDOW_BITS][LIMBS_MAX];
+        uint64_t base[LIMBS_MAX] = {0};
+        const mp_limb_t* al = mpz_limbs_read(a);
+        for (size_t j = 0; j < mpz_size(a); j++) base[j] = al[j];
+        memcpy(table[0], c.one, sizeof(table[0]));
+        mont_mul_n(table[1], base, c.r2, &c, N);
+        for (int i = 2; i < 1 << WINDOW_BITS; i++) mont_mul_n(table[i], table[i - 1], table[1], &c, N);
+
+        // Fixed window over d = (n-1) >> s, most significant bits first
+        for (int bit = top; bit >= s;) {
+            int width = bit - s + 1 < WINDOW_BITS ? bit - s + 1 : WINDOW_BITS;
+            for (int k = 0; k < width; k++) mont_sqr_n(x, x, &c, N);
+            unsigned digit = limbs_bits(nm1, bit - width + 1, width);
+            if (digit) mont_mul_n(x, x, table[digit], &c, N);
+            bit -= width;
+        }
+    }
+
+    if (limbs_equal(x, c.one, N) || limbs_equal(x, c.mone, N)) return true;
+    for (int r = 1; r < s; r++) {
+        mont_sqr_n(x, x, &c, N);
+        if (limbs_equal(x, c.mone, N)) return true;
+        if (limbs_equal(x, c.one, N)) return false;
+    }
+    return false;
+}
+
+// Strong Lucas test on the V-only chain (P = 1): per bit one multiply and
+// one square for V plus a square for Q^k, and no Q^k work at all when
+// Q = -1 (D = 5, the most common Selfridge choice). U_d is never formed:
+// D*U_d = 2*V_(d+1) - V_d, and D is a unit mod n.
+LIMBS_INLINE bool lucas_body(const mpz_t n, long Q, int N) {
+    MontCtx c;
+    mont_init(&c, n, N);
+
+    // n + 1 = d * 2^s; one extra limb in case n + 1 carries out
+    uint64_t np1[LIMBS_MAX + 1];
+    uint64_t carry = 1;
+    for (int j = 0; j < N; j++) {
+        np1[j] = c.n[j] + carry;
+        carry = np1[j] == 0 && carry;
+    }
+    np1[N] = carry;
+    int s = limbs_ctz(np1);
+    int top = limbs_top_bit(np1, N + 1);
+
+    // (v, w) = (V_k, V_(k+1)), qk = Q^k, starting at k = 1
+    uint64_t v[LIMBS_MAX], w[LIMBS_MAX], qk[LIMBS_MAX], t[LIMBS_MAX];
+    bool unit_q = Q == -1;
+    bool qk_negative = true;   // Q^k = -1 when unit_q
+    memcpy(v, c.one, sizeof(v));
+    mont_scale(qk, c.one, Q, &c, N);
+    mont_add_n(t, qk, qk, &c, N);
+    mont_sub_n(w, c.one, t, &c, N);
+
+    for (int bit = top - 1; bit >= s; bit--) {
+        const uint64_t* q = unit_q ? (qk_negative ? c.mone : c.one) : qk;
+        if (limbs_bit(np1, bit)) {
+            // k -> 2k+1: V_(2k+1) = V_k V_(k+1) - Q^k, V_(2k+2) = V_(k+1)^2 - 2Q^(k+1)
+            mont_mul_n(v, v, w, &c, N);
+            mont_sub_n(v, v, q, &c, N);
+            mont_sqr_n(w, w, &c, N);
+            if (unit_q) {
+                mont_add_n(t, q, q, &c, N);
+                mont_add_n(w, w, t, &c, N);
+                qk_negative = true;
+            } else {
+                uint64_t q1[LIMBS_MAX];
+                mont_scale(q1, qk, Q, &c, N);
+                mont_add_n(t, q1, q1, &c, N);
+                mont_sub_n(w, w, t, &c, N);
+                mont_mul_n(qk, qk, q1, &c, N);
+            }
+        } else {
+            // k -> 2k: V_(2k+1) = V_k V_(k+1) - Q^k, V_2k = V_k^2 - 2Q^k
+            mont_mul_n(w, v, w, &c, N);
+            mont_sub_n(w, w, q, &c, N);
+            mont_sqr_n(v, v, &c, N);
+            mont_add_n(t, q, q, &c, N);
+            mont_sub_n(v, v, t, &c, N);
+            if (unit_q) {
+                qk_negative = false;
+            } else {
+                mont_sqr_n(qk, qk, &c, N);
+            }
+        }
+    }
+
+    mont_add_n(t, w, w, &c, N);
+    if (limbs_equal(t, v, N) || limbs_zero(v, N)) return true;
+    if (unit_q) memcpy(qk, qk_negative ? c.mone : c.one, sizeof(qk));
+    for (int r = 1; r < s; r++) {
+        mont_sqr_n(v, v, &c, N);
+        mont_add_n(t, qk, qk, &c, N);
+        mont_sub_n(v, v, t, &c, N);
+        if (limbs_zero(v, N)) return true;
+        mont_sqr_n(qk, qk, &c, N);
+    }
+    return false;
+}
+
+bool limbs_sprp(const mpz_t n, const mpz_t a) {
+    switch (mpz_size(n)) {
+        case 2: return sprp_body(n, a, 2);
+        case 3: return sprp_body(n, a, 3);
+        case 4: return sprp_body(n, a, 4);
+        default: return sprp_body(n, a, 5);
+    }
+}
+
+bool limbs_lucas_sprp(const mpz_t n, long Q) {
+    switch (mpz_size(n)) {
+        case 2: return lucas_body(n, Q, 2);
+        case 3: return lucas_body(n, Q, 3);
+        case 4: return lucas_body(n, Q, 4);
+        default: return lucas_body(n, Q, 5);
+    }
+}
+
+// 3*5*...*47, as in program.c
+#define SMALL_PRODUCT 307444891294245705UL
+
+bool limbs_bpsw(const mpz_t n) {
+    // n >= 2^64, so any small factor makes it composite
+    if (mpz_gcd_ui(NULL, n, SMALL_PRODUCT) != 1) return false;
+
+    mp_limb_t two_limb = 2;
+    mpz_t two;
+    mpz_roinit_n(two, &two_limb, 1);
+    if (!limbs_sprp(n, two) || mpz_perfect_square_p(n)) return false;
+
+    // Selfridge: first D in 5, -7, 9, -11, ... with (D/n) = -1
+    long D = 5;
+    for (;;) {
+        int j = mpz_si_kronecker(D, n);
+        if (j == -1) break;
+        if (j == 0) return false;
+        D = D > 0 ? -(D + 2) : -D + 2;
+    }
+    return limbs_lucas_sprp(n, (1 - D) / 4);
+}
@@ -0,0 +1,31 @@
+#ifndef ENGINE_LIMBS_H
+#define ENGINE_LIMBS_H
+
+#include <stdbool.h>
+#include <gmp.h>
+
+#include "engine_tune.h"
+
+// Fixed-size Montgomery arithmetic for odd moduli of 2..5 limbs (about 20
+// to 96 digits). Each limb count gets its own fully unrolled code and
+// nothing is allocated; larger or smaller numbers stay on mpz, as do
+// sizes above the host profile's limbs_max.
+#define LIMBS_MIN 2
+#define LIMBS_MAX 5
+
+static inline bool limbs_fit(const mpz_t n) {
+    size_t size = mpz_size(n);
+    return mpz_odd_p(n) && size >= LIMBS_MIN && size <= (size_t)engine_tuning.limbs_max;
+}
+
+// Strong probable-prime test to base a, 1 < a < n - 1
+bool limbs_sprp(const mpz_t n, const mpz_t a);
+
+// Strong Lucas probable-prime test with P = 1 and Q = (1 - D)/4, where
+// the caller has already picked D with (D/n) = -1
+bool limbs_lucas_sprp(const mpz_t n, long Q);
+
+// Baillie-PSW: small-prime gcd, base-2 test, square check, strong Lucas
+bool limbs_bpsw(const mpz_t n);
+
+#endif
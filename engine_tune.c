@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "engine_limbs.h"
+#include "engine_tune.h"
+
+// The values every tool used before profiles existed
+#define TUNING_DEFAULT {.mr_lanes = MR_LANES, .limbs_max = LIMBS_MAX, .sieve_limit = 2000, \
+                        .split_max_rank = 11, .split_min_left = 4}
+
+const EngineTuning engine_tuning_default = TUNING_DEFAULT;
+EngineTuning engine_tuning = TUNING_DEFAULT;
+
+typedef struct {
+    const char* name;
+    size_t offset;
+    int min, max;
+} TuneKey;
+
+static const TuneKey tune_keys[] = {
+    {"mr_lanes", offsetof(EngineTuning, mr_lanes), 1, MR_LANES},
+    {"limbs_max", offsetof(EngineTuning, limbs_max), LIMBS_MIN - 1, LIMBS_MAX},
+    {"sieve_limit", offsetof(EngineTuning, sieve_limit), 53, 1 << 16},
+    {"split_max_rank", offsetof(EngineTuning, split_max_rank), 1, 14},
+    {"split_min_left", offsetof(EngineTuning, split_min_left), 1, 19},
+};
+#define TUNE_KEY_COUNT (int)(sizeof(tune_keys) / sizeof(tune_keys[0]))
+
+const char* engine_tune_path(void) {
+    static char path[4096];
+    const char* env = getenv("SOSU_TUNE");
+    if (env) return env;
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/.sosu-%s.tune", home ? home : ".", host);
+    return path;
+}
+
+bool engine_tune_load(const char* path, EngineTuning* t) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char* p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        char name[64];
+        int value;
+        if (sscanf(p, "%63[a-z_0-9] = %d", name, &value) != 2) {
+            fprintf(stderr, "%s:%d: 読めない行です\n", path, line_no);
+            continue;
+        }
+        int k = 0;
+        while (k < TUNE_KEY_COUNT && strcmp(tune_keys[k].name, name) != 0) k++;
+        // Keys from newer profiles are skipped, bad values keep the default
+        if (k == TUNE_KEY_COUNT) continue;
+        if (value < tune_keys[k].min || value > tune_keys[k].max) {
+            fprintf(stderr, "%s:%d: %sは%d〜%dです\n", path, line_no, name, tune_keys[k].min, tune_keys[k].max);
+            continue;
+        }
+        *(int*)((char*)t + tune_keys[k].offset) = value;
+    }
+    fclose(f);
+    return true;
+}
+
+bool engine_tune_save(const char* path, const EngineTuning* t, const char* comment) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    if (comment) fprintf(f, "# %s\n", comment);
+    for (int k = 0; k < TUNE_KEY_COUNT; k++) {
+        fprintf(f, "%s=%d\n", tune_keys[k].name, *(const int*)((const char*)t + tune_keys[k].offset));
+    }
+    return fclose(f) == 0;
+}
+
+// Before main, so the tools never see the defaults once a profile exists
+__attribute__((constructor))
+static void engine_tune_init(void) {
+    const char* path = engine_tune_path();
+    if (*path) engine_tune_load(path, &engine_tuning);
+}
@@ -0,0 +1,35 @@
+#ifndef ENGINE_TUNE_H
+#define ENGINE_TUNE_H
+
+#include <stdbool.h>
+
+// Per-host tuning profile. Every tool links engine_tune.c, which fills
+// engine_tuning from the profile before main runs; without one the tools
+// run on engine_tuning_default. `sosu autotune` measures this host and
+// writes the profile.
+//
+// The profile is key=value lines (# starts a comment) read from $SOSU_TUNE,
+// or ~/.sosu-<hostname>.tune so hosts sharing a home directory keep their
+// own. SOSU_TUNE= (empty) skips the profile.
+
+typedef struct {
+    int mr_lanes;         // is_prime_batch chunk width, 1..MR_LANES
+    int limbs_max;        // largest limb count on the fixed-limb engine; below LIMBS_MIN = mpz only
+    int sieve_limit;      // program.c primorial gcd prefilter depth
+    int split_max_rank;   // program11: choose() levels below this rank may hand off
+    int split_min_left;   // program11: arrange() hands off with this many cards left
+} EngineTuning;
+
+extern EngineTuning engine_tuning;
+extern const EngineTuning engine_tuning_default;
+
+// Profile path for this host; "" when SOSU_TUNE is set empty
+const char* engine_tune_path(void);
+
+// Reads a profile into *t (keys it does not name keep their value).
+// Returns false when the file cannot be opened.
+bool engine_tune_load(const char* path, EngineTuning* t);
+
+bool engine_tune_save(const char* path, const EngineTuning* t, const char* comment);
+
+#endif
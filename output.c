@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+
+void out_flush(Output* out) {
+    fwrite(out->buf, 1, out->len, stdout);
+    out->len = 0;
+}
+
+void out_bytes(Output* out, const void* data, size_t size) {
+    if (out->len + size > OUTPUT_BUFFER_SIZE) {
+        out_flush(out);
+        if (size > OUTPUT_BUFFER_SIZE) {
+            fwrite(data, 1, size, stdout);
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, data, size);
+    out->len += size;
+}
+
+void out_str(Output* out, const char* s) {
+    out_bytes(out, s, strlen(s));
+}
+
+void out_u64(Output* out, unsigned long long v) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[sizeof(digits) - 1 - n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    out_bytes(out, digits + sizeof(digits) - n, n);
+}
+
+void out_int(Output* out, int v) {
+    if (v < 0) out_bytes(out, "-", 1);
+    out_u64(out, v < 0 ? -(long long)v : v);
+}
+
+void out_le(Output* out, unsigned long long v, int size) {
+    unsigned char bytes[8];
+    for (int i = 0; i < size; i++) bytes[i] = (unsigned char)(v >> (8 * i));
+    out_bytes(out, bytes, size);
+}
+
+bool parse_output_flag(const char* arg, Output* out) {
+    if (strcmp(arg, "--no-echo") == 0) {
+        out->echo = false;
+    } else if (strcmp(arg, "--format=text") == 0) {
+        out->format = FORMAT_TEXT;
+    } else if (strcmp(arg, "--format=ndjson") == 0) {
+        out->format = FORMAT_NDJSON;
+    } else if (strcmp(arg, "--format=binary") == 0) {
+        out->format = FORMAT_BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int take_output_flags(Output* out, int argc, char** argv) {
+    int argn = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!parse_output_flag(argv[i], out)) argv[argn++] = argv[i];
+    }
+    return argn;
+}
+
+void out_cards_text(Output* out, const int* cards, int size) {
+    for (int i = 0; i < size; i++) {
+        if (i > 0) out_bytes(out, ",", 1);
+        out_u64(out, cards[i]);
+    }
+}
+
+void out_hit_record(Output* out, const int* cards, int size, unsigned long long num) {
+    if (out->format == FORMAT_BINARY) {
+        out_le(out, size, 1);
+        for (int i = 0; i < size; i++) out_le(out, cards[i], 1);
+        out_le(out, num, 8);
+        return;
+    }
+    out_str(out, "{\"cards\":[");
+    out_cards_text(out, cards, size);
+    out_str(out, "],\"n\":\"");
+    out_u64(out, num);
+    out_str(out, "\"}\n");
+}
+
+void out_hit(Output* out, const int* cards, int size, unsigned long long num) {
+    if (out->format != FORMAT_TEXT) {
+        out_hit_record(out, cards, size, num);
+        return;
+    }
+    out_cards_text(out, cards, size);
+    out_str(out, " -> ");
+    out_u64(out, num);
+    out_bytes(out, "\n", 1);
+}
+
+void store_hit(HitStore* store, const int* cards, int size, unsigned long long num) {
+    if (store->count == store->capacity) {
+        store->capacity = store->capacity ? store->capacity * 2 : 64;
+        store->hits = realloc(store->hits, store->capacity * sizeof(StoredHit));
+    }
+    while (store->cards_size + size > store->cards_capacity) {
+        store->cards_capacity = store->cards_capacity ? store->cards_capacity * 2 : 256;
+        store->cards = realloc(store->cards, store->cards_capacity * sizeof(int));
+    }
+    memcpy(store->cards + store->cards_size, cards, size * sizeof(int));
+    store->hits[store->count++] = (StoredHit){num, store->cards_size, size};
+    store->cards_size += size;
+}
+
+static int compare_stored_hits(const void* a, const void* b) {
+    const StoredHit* pa = (const StoredHit*)a;
+    const StoredHit* pb = (const StoredHit*)b;
+    if (pa->num < pb->num) return -1;
+    if (pa->num > pb->num) return 1;
+    return 0;
+}
+
+void out_stored_hits(Output* out, HitStore* store) {
+    qsort(store->hits, store->count, sizeof(StoredHit), compare_stored_hits);
+    if (out->format == FORMAT_TEXT) out_str(out, "Sorted primes:\n");
+    for (size_t i = 0; i < store->count; i++) {
+        const StoredHit* h = &store->hits[i];
+        if (i > 0 && h->num == store->hits[i - 1].num) continue;
+        out_hit(out, store->cards + h->offset, h->size, h->num);
+    }
+    free(store->hits);
+    free(store->cards);
+}
@@ -0,0 +1,66 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Output layer for the card tools: records go through one large buffer
+// instead of a printf per card. text keeps the legacy layout, ndjson
+// writes one object per line, binary writes packed little-endian records.
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+typedef enum { FORMAT_TEXT, FORMAT_NDJSON, FORMAT_BINARY } OutputFormat;
+
+typedef struct {
+    OutputFormat format;
+    bool echo;              // per-hit output; --no-echo keeps only the final set
+    size_t len;
+    char buf[OUTPUT_BUFFER_SIZE];
+} Output;
+
+void out_flush(Output* out);
+void out_bytes(Output* out, const void* data, size_t size);
+void out_str(Output* out, const char* s);
+void out_u64(Output* out, unsigned long long v);
+void out_int(Output* out, int v);
+
+// Fixed-width little-endian integer for binary records
+void out_le(Output* out, unsigned long long v, int size);
+
+// --no-echo and --format=text|ndjson|binary; false for any other argument
+bool parse_output_flag(const char* arg, Output* out);
+
+// Drops the output flags from argv into *out; returns the new argc
+int take_output_flags(Output* out, int argc, char** argv);
+
+// Ranks as "13,1,2"
+void out_cards_text(Output* out, const int* cards, int size);
+
+// One hit as a structured record:
+//   ndjson: {"cards":[13,1,2],"n":"1312"}
+//   binary: u8 card count, one u8 rank per card, u64 value
+void out_hit_record(Output* out, const int* cards, int size, unsigned long long num);
+
+// One entry of a final set: "cards -> n" in text, a record otherwise
+void out_hit(Output* out, const int* cards, int size, unsigned long long num);
+
+// --no-echo keeps every hit until the end: value plus a run of cards
+typedef struct {
+    unsigned long long num;
+    size_t offset;
+    int size;
+} StoredHit;
+
+typedef struct {
+    StoredHit* hits;
+    size_t count, capacity;
+    int* cards;
+    size_t cards_size, cards_capacity;
+} HitStore;
+
+void store_hit(HitStore* store, const int* cards, int size, unsigned long long num);
+
+// The final set: ascending, one entry per distinct value. Frees the store.
+void out_stored_hits(Output* out, HitStore* store);
+
+#endif
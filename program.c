@@ -6,101 +6,1029 @@
 #include <gmp.h>
 #include <time.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "engine.h"
+#include "engine_limbs.h"
+#include "output.h"
 
 #define MAX_DIGITS 90
 #define MIN_DIGITS 1
 #define MAX_PRIMES 40000
 
+#define DEFAULT_EXTRA_ROUNDS 1
+
+// 3*5*...*47 fits in an unsigned long, so one mpz_fdiv_ui gives every residue
+static const unsigned long small_primes[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47};
+#define SMALL_PRODUCT 307444891294245705UL
+
 typedef struct {
-    mpz_t num;
-} BigInt;
-
-BigInt primes[MAX_PRIMES];
-int prime_count = 0;
-// Check if a number is prime and not already in the list
-bool is_unique_prime(mpz_t num) {
-    if (mpz_probab_prime_p(num, 25) == 0) {
-        return false;
+    mpz_t primorial;    // product of primes 53..sieve_limit
+    unsigned long sieve_limit;  // prefilter depth from the host profile
+    mpz_t g, d, x, nm1; // Miller-Rabin / gcd scratch
+    mpz_t U, V, Qk, t;  // Lucas scratch
+    gmp_randstate_t rand;
+    int extra_rounds;
+} PrimeScratch;
+
+void init_prime_scratch(PrimeScratch *ps, int extra_rounds) {
+    mpz_inits(ps->primorial, ps->g, ps->d, ps->x, ps->nm1, ps->U, ps->V, ps->Qk, ps->t, NULL);
+    ps->sieve_limit = engine_tuning.sieve_limit;
+    mpz_primorial_ui(ps->primorial, ps->sieve_limit);
+    mpz_divexact_ui(ps->primorial, ps->primorial, 2 * SMALL_PRODUCT);
+    gmp_randinit_default(ps->rand);
+    gmp_randseed_ui(ps->rand, time(NULL));
+    ps->extra_rounds = extra_rounds;
+}
+
+void clear_prime_scratch(PrimeScratch *ps) {
+    mpz_clears(ps->primorial, ps->g, ps->d, ps->x, ps->nm1, ps->U, ps->V, ps->Qk, ps->t, NULL);
+    gmp_randclear(ps->rand);
+}
+
+// Strong probable-prime test to base a; n must be odd and > 3
+bool strong_probable_prime(const mpz_t n, const mpz_t a, PrimeScratch *ps) {
+    if (limbs_fit(n)) return limbs_sprp(n, a);
+    mpz_sub_ui(ps->nm1, n, 1);
+    mp_bitcnt_t s = mpz_scan1(ps->nm1, 0);
+    mpz_tdiv_q_2exp(ps->d, ps->nm1, s);
+    mpz_powm(ps->x, a, ps->d, n);
+
+    if (mpz_cmp_ui(ps->x, 1) == 0 || mpz_cmp(ps->x, ps->nm1) == 0) return true;
+    for (mp_bitcnt_t r = 1; r < s; r++) {
+        mpz_powm_ui(ps->x, ps->x, 2, n);
+        if (mpz_cmp(ps->x, ps->nm1) == 0) return true;
+        if (mpz_cmp_ui(ps->x, 1) == 0) return false;
     }
+    return false;
+}
 
-    for (int i = 0; i < prime_count; i++) {
-        if (mpz_cmp(primes[i].num, num) == 0) {
-            return false;
+// Halves x modulo odd n, for x in [0, 2n)
+static void mod_half(mpz_t x, const mpz_t n) {
+    if (mpz_odd_p(x)) mpz_add(x, x, n);
+    mpz_tdiv_q_2exp(x, x, 1);
+    if (mpz_cmp(x, n) >= 0) mpz_sub(x, x, n);
+}
+
+// Strong Lucas probable-prime test with Selfridge parameters (P = 1);
+// n must be odd, > 3 and not a perfect square
+bool strong_lucas_probable_prime(const mpz_t n, PrimeScratch *ps) {
+    long D = 5;
+    for (;;) {
+        mpz_set_si(ps->t, D);
+        int j = mpz_jacobi(ps->t, n);
+        if (j == -1) break;
+        if (j == 0 && mpz_cmpabs_ui(n, labs(D)) != 0) return false;
+        D = D > 0 ? -(D + 2) : -D + 2;
+    }
+    long Q = (1 - D) / 4;
+    if (limbs_fit(n)) return limbs_lucas_sprp(n, Q);
+
+    // n + 1 = d * 2^s
+    mpz_add_ui(ps->d, n, 1);
+    mp_bitcnt_t s = mpz_scan1(ps->d, 0);
+    mpz_tdiv_q_2exp(ps->d, ps->d, s);
+
+    // Left-to-right over d, starting from U_1 = 1, V_1 = P = 1
+    mpz_set_ui(ps->U, 1);
+    mpz_set_ui(ps->V, 1);
+    mpz_set_si(ps->Qk, Q);
+    mpz_mod(ps->Qk, ps->Qk, n);
+    for (long bit = (long)mpz_sizeinbase(ps->d, 2) - 2; bit >= 0; bit--) {
+        // k -> 2k
+        mpz_mul(ps->U, ps->U, ps->V);
+        mpz_mod(ps->U, ps->U, n);
+        mpz_mul(ps->V, ps->V, ps->V);
+        mpz_submul_ui(ps->V, ps->Qk, 2);
+        mpz_mod(ps->V, ps->V, n);
+        mpz_mul(ps->Qk, ps->Qk, ps->Qk);
+        mpz_mod(ps->Qk, ps->Qk, n);
+
+        if (mpz_tstbit(ps->d, bit)) {
+            // k -> k+1: U' = (U + V)/2, V' = (D*U + V)/2
+            mpz_mul_si(ps->t, ps->U, D);
+            mpz_add(ps->U, ps->U, ps->V);
+            mod_half(ps->U, n);
+            mpz_add(ps->V, ps->V, ps->t);
+            mpz_mod(ps->V, ps->V, n);
+            mod_half(ps->V, n);
+            mpz_mul_si(ps->Qk, ps->Qk, Q);
+            mpz_mod(ps->Qk, ps->Qk, n);
         }
     }
+
+    if (mpz_sgn(ps->U) == 0 || mpz_sgn(ps->V) == 0) return true;
+    for (mp_bitcnt_t r = 1; r < s; r++) {
+        mpz_mul(ps->V, ps->V, ps->V);
+        mpz_submul_ui(ps->V, ps->Qk, 2);
+        mpz_mod(ps->V, ps->V, n);
+        if (mpz_sgn(ps->V) == 0) return true;
+        mpz_mul(ps->Qk, ps->Qk, ps->Qk);
+        mpz_mod(ps->Qk, ps->Qk, n);
+    }
+    return false;
+}
+
+// Staged test: residue sieve, primorial gcd, BPSW, then optional random rounds
+bool is_probable_prime(const mpz_t num, PrimeScratch *ps) {
+    if (mpz_cmp_ui(num, 2) < 0) return false;
+    if (mpz_even_p(num)) return mpz_cmp_ui(num, 2) == 0;
+
+    unsigned long r = mpz_fdiv_ui(num, SMALL_PRODUCT);
+    for (size_t i = 0; i < sizeof(small_primes) / sizeof(small_primes[0]); i++) {
+        if (r % small_primes[i] == 0) return mpz_cmp_ui(num, small_primes[i]) == 0;
+    }
+
+    // A factor in 53..sieve_limit means composite unless num is that
+    // factor. g == num is not enough (53*109 divides the primorial too), so
+    // a num that small gets the exact 64-bit test. Without such a factor,
+    // every factor exceeds sieve_limit and below its square num is prime.
+    mpz_gcd(ps->g, num, ps->primorial);
+    if (mpz_cmp_ui(ps->g, 1) != 0) return mpz_cmp_ui(num, ps->sieve_limit) <= 0 && is_prime(mpz_get_ui(num));
+    if (mpz_cmp_ui(num, ps->sieve_limit * ps->sieve_limit) < 0) return true;
+
+    mpz_set_ui(ps->t, 2);
+    if (!strong_probable_prime(num, ps->t, ps)) return false;
+    if (mpz_perfect_square_p(num)) return false;
+    if (!strong_lucas_probable_prime(num, ps)) return false;
+
+    for (int i = 0; i < ps->extra_rounds; i++) {
+        // Random base in [2, n-2]
+        mpz_sub_ui(ps->t, num, 3);
+        mpz_urandomm(ps->t, ps->rand, ps->t);
+        mpz_add_ui(ps->t, ps->t, 2);
+        if (!strong_probable_prime(num, ps->t, ps)) return false;
+    }
     return true;
 }
 
+#define ARENA_CHUNK (1 << 20)
+#define ARENA_MAX_BLOCK (ARENA_CHUNK / 4) // larger requests go straight to malloc
+#define STORE_CHUNK (1 << 16)
+
+// Per-thread bump arena behind GMP's memory functions. Blocks are popped
+// when freed in LIFO order, which matches how GMP uses temporaries; a block
+// freed out of order is only marked and reclaimed once everything above it
+// is gone.
+typedef struct ArenaChunk {
+    struct ArenaChunk *prev;
+    struct Arena *owner;
+    struct BlockHeader *last;
+    size_t used;
+    _Alignas(16) unsigned char data[];
+} ArenaChunk;
+
+typedef struct BlockHeader {
+    ArenaChunk *chunk; // NULL for blocks that came from malloc
+    struct BlockHeader *prev;
+    size_t size;
+    atomic_int freed;
+} __attribute__((aligned(16))) BlockHeader;
+
+typedef struct Arena {
+    ArenaChunk *top;
+    ArenaChunk *spare;
+} Arena;
+
+static _Thread_local Arena thread_arena;
+
+static size_t align16(size_t n) {
+    return (n + 15) & ~(size_t)15;
+}
+
+static ArenaChunk *arena_new_chunk(Arena *arena) {
+    ArenaChunk *c = arena->spare;
+    if (c) {
+        arena->spare = NULL;
+    } else {
+        c = malloc(sizeof(ArenaChunk) + ARENA_CHUNK);
+        if (!c) abort();
+    }
+    c->prev = arena->top;
+    c->owner = arena;
+    c->last = NULL;
+    c->used = 0;
+    arena->top = c;
+    return c;
+}
+
+// Pops freed blocks off the top of the arena, releasing emptied chunks
+static void arena_pop(Arena *arena) {
+    ArenaChunk *c = arena->top;
+    while (c) {
+        while (c->last && atomic_load(&c->last->freed)) {
+            c->used = (unsigned char *)c->last - c->data;
+            c->last = c->last->prev;
+        }
+        if (c->last || !c->prev) break;
+        arena->top = c->prev;
+        free(arena->spare);
+        arena->spare = c;
+        c = arena->top;
+    }
+}
+
+void *arena_alloc(size_t size) {
+    size_t need = sizeof(BlockHeader) + align16(size);
+    BlockHeader *h;
+    if (need > ARENA_MAX_BLOCK) {
+        h = malloc(need);
+        if (!h) abort();
+        h->chunk = NULL;
+    } else {
+        Arena *arena = &thread_arena;
+        ArenaChunk *c = arena->top;
+        if (!c || c->used + need > ARENA_CHUNK) c = arena_new_chunk(arena);
+        h = (BlockHeader *)(c->data + c->used);
+        h->chunk = c;
+        h->prev = c->last;
+        c->last = h;
+        c->used += need;
+    }
+    h->size = size;
+    atomic_init(&h->freed, 0);
+    return h + 1;
+}
+
+void arena_free(void *ptr, size_t size) {
+    (void)size;
+    if (!ptr) return;
+    BlockHeader *h = (BlockHeader *)ptr - 1;
+    if (!h->chunk) {
+        free(h);
+        return;
+    }
+    atomic_store(&h->freed, 1);
+    if (h->chunk->owner == &thread_arena && h->chunk->last == h) arena_pop(&thread_arena);
+}
+
+void *arena_realloc(void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(new_size);
+    BlockHeader *h = (BlockHeader *)ptr - 1;
+    ArenaChunk *c = h->chunk;
+    // The topmost block of this thread's arena can grow in place
+    if (c && c->owner == &thread_arena && c->last == h) {
+        size_t start = (unsigned char *)h - c->data;
+        size_t need = sizeof(BlockHeader) + align16(new_size);
+        if (start + need <= ARENA_CHUNK && need <= ARENA_MAX_BLOCK) {
+            c->used = start + need;
+            h->size = new_size;
+            return ptr;
+        }
+    }
+    void *moved = arena_alloc(new_size);
+    memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    arena_free(ptr, old_size);
+    return moved;
+}
+
+// Returns the calling thread's chunks once all of its GMP data is cleared
+void arena_release(void) {
+    Arena *arena = &thread_arena;
+    while (arena->top) {
+        ArenaChunk *prev = arena->top->prev;
+        free(arena->top);
+        arena->top = prev;
+    }
+    free(arena->spare);
+    arena->spare = NULL;
+}
+
+// Each worker fills its own Output (output.h) and hands it to stdout in
+// one fwrite. Whole records go in with one out_bytes call, so a flush
+// never splits a record between two threads' writes.
+void out_prime(Output *out, const mpz_t num) {
+    unsigned char record[MAX_DIGITS + 16];
+    size_t len = 0;
+    if (out->format == FORMAT_BINARY) {
+        // u16 LE byte count, then the magnitude most significant byte first
+        size_t bytes;
+        mpz_export(record + 2, &bytes, 1, 1, 1, 0, num);
+        record[0] = bytes & 0xFF;
+        record[1] = bytes >> 8;
+        len = bytes + 2;
+    } else {
+        if (out->format == FORMAT_NDJSON) {
+            memcpy(record, "{\"n\":\"", 6);
+            len = 6;
+        }
+        mpz_get_str((char *)record + len, 10, num);
+        len += strlen((char *)record + len);
+        if (out->format == FORMAT_NDJSON) {
+            memcpy(record + len, "\"}", 2);
+            len += 2;
+        }
+        record[len++] = '\n';
+    }
+    out_bytes(out, record, len);
+}
+
+uint64_t hash_mpz(const mpz_t num) {
+    uint64_t h = 1469598103934665603ULL;
+    size_t n = mpz_size(num);
+    for (size_t i = 0; i < n; i++) {
+        h ^= mpz_getlimbn(num, i);
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+// Result sink for --top=K and --run-size=N. The prime set above is capped
+// at MAX_PRIMES; with a sink, primes found past the cap are no longer
+// dropped. --top=K keeps the K largest in a min-heap, --run-size=N spills
+// sorted, deduplicated runs of N primes to temporary files and merges them
+// at the end, so memory stays bounded however long the search runs.
+// Primes are plain limb records: GMP memory here belongs to one thread's
+// arena, while the sink is shared.
+#define PRIME_LIMBS ((MAX_DIGITS * 3322 / 1000) / GMP_NUMB_BITS + 1)
+#define RUN_FAN_IN 16           // runs merged into one at a time
+
+typedef struct {
+    mp_size_t size;
+    mp_limb_t limbs[PRIME_LIMBS];
+} SinkPrime;
+
+// A spilled run and how many merges went into it. Every RUN_FAN_IN runs of
+// one level are merged into one run of the next, so open files grow with
+// the log of the primes, not with the primes.
+typedef struct {
+    FILE *fp;
+    int level;
+} SpillRun;
+
+typedef struct {
+    pthread_mutex_t lock;   // found primes are rare next to tests, so cold
+    int top;                // 0: no top-K heap
+    size_t run_size;        // 0: never spill
+    SinkPrime *items;       // current run, or the heap (smallest first)
+    size_t size, capacity;
+    SinkPrime *seen;        // the heap's primes, open addressing; size 0 is empty
+    size_t seen_mask;
+    SpillRun *runs;
+    int run_count;
+} ResultSink;
+
+int compare_sink_primes(const void *a, const void *b) {
+    const SinkPrime *pa = a;
+    const SinkPrime *pb = b;
+    if (pa->size != pb->size) return pa->size < pb->size ? -1 : 1;
+    return mpn_cmp(pa->limbs, pb->limbs, pa->size);
+}
+
+static size_t seen_home(const ResultSink *sink, const SinkPrime *p) {
+    mpz_t view;
+    mpz_roinit_n(view, p->limbs, p->size);
+    return hash_mpz(view) & sink->seen_mask;
+}
+
+// The slot holding p, or the empty slot where it would go
+static size_t seen_slot(const ResultSink *sink, const SinkPrime *p) {
+    size_t i = seen_home(sink, p);
+    while (sink->seen[i].size != 0 && compare_sink_primes(&sink->seen[i], p) != 0) {
+        i = (i + 1) & sink->seen_mask;
+    }
+    return i;
+}
+
+// Deleting from a probe chain: later entries that hashed at or before the
+// hole move back into it, so lookups never stop short
+static void seen_remove(ResultSink *sink, const SinkPrime *p) {
+    size_t i = seen_slot(sink, p);
+    if (sink->seen[i].size == 0) return;
+    for (size_t j = i;;) {
+        sink->seen[i].size = 0;
+        for (;;) {
+            j = (j + 1) & sink->seen_mask;
+            if (sink->seen[j].size == 0) return;
+            size_t home = seen_home(sink, &sink->seen[j]);
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue;
+            sink->seen[i] = sink->seen[j];
+            i = j;
+            break;
+        }
+    }
+}
+
+static void sink_heap_down(SinkPrime *heap, size_t size, size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < size && compare_sink_primes(&heap[l], &heap[m]) < 0) m = l;
+        if (r < size && compare_sink_primes(&heap[r], &heap[m]) < 0) m = r;
+        if (m == i) return;
+        SinkPrime t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+static FILE *run_create(void) {
+    FILE *fp = tmpfile();
+    if (!fp) {
+        perror("tmpfile");
+        exit(1);
+    }
+    return fp;
+}
+
+static bool run_next(FILE *fp, SinkPrime *p) {
+    return fread(p, sizeof(SinkPrime), 1, fp) == 1;
+}
+
+// k-way merge of `count` runs over a min-heap of run indices, keyed on each
+// run's head. The distinct primes go in ascending order to `dest` as a new
+// run, or to `out` when dest is NULL. Closes the input runs.
+static void merge_runs(const SpillRun *runs, int count, FILE *dest, Output *out) {
+    SinkPrime *heads = malloc((count ? count : 1) * sizeof(SinkPrime));
+    int *heap = malloc((count ? count : 1) * sizeof(int));
+    int heap_size = 0;
+    for (int r = 0; r < count; r++) {
+        if (!run_next(runs[r].fp, &heads[r])) continue;
+        int i = heap_size++;
+        heap[i] = r;
+        while (i > 0 && compare_sink_primes(&heads[heap[i]], &heads[heap[(i - 1) / 2]]) < 0) {
+            int t = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = t;
+            i = (i - 1) / 2;
+        }
+    }
+
+    SinkPrime last = {0};
+    mpz_t view;
+    while (heap_size > 0) {
+        int r = heap[0];
+        if (last.size == 0 || compare_sink_primes(&heads[r], &last) != 0) {
+            last = heads[r];
+            if (dest) {
+                fwrite(&last, sizeof(SinkPrime), 1, dest);
+            } else {
+                mpz_roinit_n(view, last.limbs, last.size);
+                out_prime(out, view);
+            }
+        }
+        if (!run_next(runs[r].fp, &heads[r])) heap[0] = heap[--heap_size];
+        for (int i = 0;;) {
+            int l = 2 * i + 1, rr = l + 1, m = i;
+            if (l < heap_size && compare_sink_primes(&heads[heap[l]], &heads[heap[m]]) < 0) m = l;
+            if (rr < heap_size && compare_sink_primes(&heads[heap[rr]], &heads[heap[m]]) < 0) m = rr;
+            if (m == i) break;
+            int t = heap[i];
+            heap[i] = heap[m];
+            heap[m] = t;
+            i = m;
+        }
+    }
+    for (int r = 0; r < count; r++) fclose(runs[r].fp);
+    free(heads);
+    free(heap);
+}
+
+static void sink_spill(ResultSink *sink) {
+    qsort(sink->items, sink->size, sizeof(SinkPrime), compare_sink_primes);
+    FILE *fp = run_create();
+    for (size_t i = 0; i < sink->size; i++) {
+        if (i > 0 && compare_sink_primes(&sink->items[i], &sink->items[i - 1]) == 0) continue;
+        fwrite(&sink->items[i], sizeof(SinkPrime), 1, fp);
+    }
+    rewind(fp);
+    sink->runs = realloc(sink->runs, (sink->run_count + 1) * sizeof(SpillRun));
+    sink->runs[sink->run_count++] = (SpillRun){fp, 0};
+    sink->size = 0;
+
+    // Levels never rise along runs[], so the last RUN_FAN_IN share a level
+    // exactly when the first and last of them do
+    while (sink->run_count >= RUN_FAN_IN) {
+        SpillRun *tail = &sink->runs[sink->run_count - RUN_FAN_IN];
+        if (tail->level != sink->runs[sink->run_count - 1].level) break;
+        FILE *merged = run_create();
+        merge_runs(tail, RUN_FAN_IN, merged, NULL);
+        rewind(merged);
+        *tail = (SpillRun){merged, tail->level + 1};
+        sink->run_count -= RUN_FAN_IN - 1;
+    }
+}
+
+void sink_add(ResultSink *sink, const mpz_t num) {
+    SinkPrime p = {0};
+    p.size = mpz_size(num);
+    memcpy(p.limbs, mpz_limbs_read(num), p.size * sizeof(mp_limb_t));
+
+    pthread_mutex_lock(&sink->lock);
+    if (sink->top > 0) {
+        bool keep = sink->size < (size_t)sink->top || compare_sink_primes(&p, &sink->items[0]) > 0;
+        // Past MAX_PRIMES the same prime can arrive again
+        size_t slot = keep ? seen_slot(sink, &p) : 0;
+        if (keep && sink->seen[slot].size != 0) keep = false;
+        if (keep && sink->size < (size_t)sink->top) {
+            sink->seen[slot] = p;
+            size_t i = sink->size++;
+            sink->items[i] = p;
+            while (i > 0 && compare_sink_primes(&sink->items[i], &sink->items[(i - 1) / 2]) < 0) {
+                SinkPrime t = sink->items[i];
+                sink->items[i] = sink->items[(i - 1) / 2];
+                sink->items[(i - 1) / 2] = t;
+                i = (i - 1) / 2;
+            }
+        } else if (keep) {
+            seen_remove(sink, &sink->items[0]);
+            sink->seen[seen_slot(sink, &p)] = p;
+            sink->items[0] = p;
+            sink_heap_down(sink->items, sink->size, 0);
+        }
+    } else {
+        sink->items[sink->size++] = p;
+        if (sink->size == sink->run_size) sink_spill(sink);
+    }
+    pthread_mutex_unlock(&sink->lock);
+}
+
+void sink_init(ResultSink *sink, int top, size_t run_size) {
+    memset(sink, 0, sizeof(*sink));
+    pthread_mutex_init(&sink->lock, NULL);
+    sink->top = top;
+    sink->run_size = run_size;
+    sink->capacity = top > 0 ? (size_t)top : run_size;
+    sink->items = malloc(sink->capacity * sizeof(SinkPrime));
+    if (!sink->items) abort();
+    if (top > 0) {
+        size_t slots = 16;
+        while (slots < 2 * (size_t)top) slots *= 2;
+        sink->seen = calloc(slots, sizeof(SinkPrime));
+        if (!sink->seen) abort();
+        sink->seen_mask = slots - 1;
+    }
+}
+
+// Writes the distinct primes in ascending order
+void sink_write(ResultSink *sink, Output *out) {
+    if (sink->top > 0) {
+        mpz_t view;
+        qsort(sink->items, sink->size, sizeof(SinkPrime), compare_sink_primes);
+        for (size_t i = 0; i < sink->size; i++) {
+            mpz_roinit_n(view, sink->items[i].limbs, sink->items[i].size);
+            out_prime(out, view);
+        }
+        return;
+    }
+
+    if (sink->size > 0) sink_spill(sink);
+    merge_runs(sink->runs, sink->run_count, NULL, out);
+    sink->run_count = 0;
+}
+
+void sink_clear(ResultSink *sink) {
+    for (int i = 0; i < sink->run_count; i++) fclose(sink->runs[i].fp);
+    free(sink->runs);
+    free(sink->seen);
+    free(sink->items);
+    pthread_mutex_destroy(&sink->lock);
+}
+
+#define ITERATIONS 100000
+#define BLOCK_SIZE 256       // iterations a worker claims at once
+#define DEQUE_CAPACITY 1024  // must be a power of two >= BLOCK_SIZE
+#define SET_SHARDS 64
+
+// One primality job: the candidate's decimal digits
+typedef struct {
+    char digits[MAX_DIGITS + 1];
+} Job;
+
+// Per-worker deque: the owner pushes and pops at the bottom, thieves take
+// from the top, so stolen jobs are the oldest ones
+typedef struct {
+    pthread_mutex_t lock;
+    size_t top, bottom;
+    Job jobs[DEQUE_CAPACITY];
+} Deque;
+
+// A found prime as a length-prefixed limb span, packed into its shard's store
+typedef struct SetNode {
+    struct SetNode *next;
+    uint64_t hash;
+    mp_size_t size;
+    mp_limb_t limbs[];
+} SetNode;
+
+typedef struct StoreChunk {
+    struct StoreChunk *prev;
+    size_t used;
+    _Alignas(16) unsigned char data[];
+} StoreChunk;
+
+typedef struct {
+    pthread_mutex_t lock;
+    SetNode **buckets;
+    size_t bucket_count;
+    size_t size;
+    StoreChunk *store;
+} SetShard;
+
+// Concurrent dedup set of found primes, sharded by hash to spread the locks
+typedef struct {
+    SetShard shards[SET_SHARDS];
+    atomic_int count;
+} PrimeSet;
+
+typedef struct Worker {
+    int id;
+    pthread_t thread;
+    uint64_t rng;
+    Deque deque;
+    PrimeScratch ps;
+    mpz_t candidate;
+    struct Pool *pool;
+    Output out;             // echo of the primes this worker finds
+} Worker;
+
+typedef struct Pool {
+    Worker *workers;
+    int worker_count;
+    int max_repeats[12];
+    int extra_rounds;
+    atomic_int next_iteration;
+    atomic_int outstanding; // claimed iterations not yet finished
+    PrimeSet set;
+    bool use_sink;
+    ResultSink sink;
+} Pool;
+
+void deque_init(Deque *dq) {
+    pthread_mutex_init(&dq->lock, NULL);
+    dq->top = dq->bottom = 0;
+}
+
+void deque_push(Deque *dq, const Job *job) {
+    pthread_mutex_lock(&dq->lock);
+    dq->jobs[dq->bottom++ & (DEQUE_CAPACITY - 1)] = *job;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+bool deque_pop(Deque *dq, Job *job) {
+    bool ok = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        *job = dq->jobs[--dq->bottom & (DEQUE_CAPACITY - 1)];
+        ok = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+bool deque_steal(Deque *dq, Job *job) {
+    bool ok = false;
+    if (pthread_mutex_trylock(&dq->lock) != 0) return false;
+    if (dq->bottom > dq->top) {
+        *job = dq->jobs[dq->top++ & (DEQUE_CAPACITY - 1)];
+        ok = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+void set_init(PrimeSet *set) {
+    for (int i = 0; i < SET_SHARDS; i++) {
+        SetShard *sh = &set->shards[i];
+        pthread_mutex_init(&sh->lock, NULL);
+        sh->bucket_count = 64;
+        sh->buckets = calloc(sh->bucket_count, sizeof(SetNode *));
+        sh->size = 0;
+        sh->store = NULL;
+    }
+    atomic_init(&set->count, 0);
+}
+
+// Bump-allocates a node with room for `limbs` limbs from the shard's store
+static SetNode *shard_new_node(SetShard *sh, mp_size_t limbs) {
+    size_t need = (sizeof(SetNode) + limbs * sizeof(mp_limb_t) + 15) & ~(size_t)15;
+    if (!sh->store || sh->store->used + need > STORE_CHUNK) {
+        StoreChunk *c = malloc(sizeof(StoreChunk) + STORE_CHUNK);
+        if (!c) abort();
+        c->prev = sh->store;
+        c->used = 0;
+        sh->store = c;
+    }
+    SetNode *n = (SetNode *)(sh->store->data + sh->store->used);
+    sh->store->used += need;
+    return n;
+}
+
+// Read-only mpz view of a stored prime; needs no allocation
+static void node_view(mpz_t view, const SetNode *n) {
+    mpz_roinit_n(view, n->limbs, n->size);
+}
+
+static SetNode *shard_find(SetShard *sh, const mpz_t num, uint64_t hash) {
+    mp_size_t size = mpz_size(num);
+    const mp_limb_t *limbs = mpz_limbs_read(num);
+    for (SetNode *n = sh->buckets[(hash / SET_SHARDS) & (sh->bucket_count - 1)]; n; n = n->next) {
+        if (n->hash == hash && n->size == size && mpn_cmp(n->limbs, limbs, size) == 0) return n;
+    }
+    return NULL;
+}
+
+static void shard_grow(SetShard *sh) {
+    size_t count = sh->bucket_count * 2;
+    SetNode **buckets = calloc(count, sizeof(SetNode *));
+    for (size_t i = 0; i < sh->bucket_count; i++) {
+        SetNode *n = sh->buckets[i];
+        while (n) {
+            SetNode *next = n->next;
+            size_t b = (n->hash / SET_SHARDS) & (count - 1);
+            n->next = buckets[b];
+            buckets[b] = n;
+            n = next;
+        }
+    }
+    free(sh->buckets);
+    sh->buckets = buckets;
+    sh->bucket_count = count;
+}
+
+bool set_contains(PrimeSet *set, const mpz_t num) {
+    uint64_t hash = hash_mpz(num);
+    SetShard *sh = &set->shards[hash % SET_SHARDS];
+    pthread_mutex_lock(&sh->lock);
+    bool found = shard_find(sh, num, hash) != NULL;
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
+// Takes one of the MAX_PRIMES result slots, if any are left
+static bool reserve_slot(atomic_int *count) {
+    int c = atomic_load(count);
+    while (c < MAX_PRIMES) {
+        if (atomic_compare_exchange_weak(count, &c, c + 1)) return true;
+    }
+    return false;
+}
+
+// Returns true if num was added, false if present or the set is full
+bool set_insert(PrimeSet *set, const mpz_t num) {
+    uint64_t hash = hash_mpz(num);
+    SetShard *sh = &set->shards[hash % SET_SHARDS];
+    bool added = false;
+    pthread_mutex_lock(&sh->lock);
+    if (!shard_find(sh, num, hash) && reserve_slot(&set->count)) {
+        mp_size_t size = mpz_size(num);
+        SetNode *n = shard_new_node(sh, size);
+        n->size = size;
+        memcpy(n->limbs, mpz_limbs_read(num), size * sizeof(mp_limb_t));
+        n->hash = hash;
+        size_t b = (hash / SET_SHARDS) & (sh->bucket_count - 1);
+        n->next = sh->buckets[b];
+        sh->buckets[b] = n;
+        if (++sh->size > sh->bucket_count) shard_grow(sh);
+        added = true;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return added;
+}
+
+bool set_full(PrimeSet *set) {
+    return atomic_load(&set->count) >= MAX_PRIMES;
+}
+
+// Collects every stored prime into an array of node pointers
+SetNode **set_collect(PrimeSet *set, size_t *count) {
+    size_t total = 0;
+    for (int i = 0; i < SET_SHARDS; i++) total += set->shards[i].size;
+    SetNode **all = malloc((total ? total : 1) * sizeof(SetNode *));
+    size_t k = 0;
+    for (int i = 0; i < SET_SHARDS; i++) {
+        SetShard *sh = &set->shards[i];
+        for (size_t b = 0; b < sh->bucket_count; b++) {
+            for (SetNode *n = sh->buckets[b]; n; n = n->next) all[k++] = n;
+        }
+    }
+    *count = total;
+    return all;
+}
+
+void set_clear(PrimeSet *set) {
+    for (int i = 0; i < SET_SHARDS; i++) {
+        SetShard *sh = &set->shards[i];
+        while (sh->store) {
+            StoreChunk *prev = sh->store->prev;
+            free(sh->store);
+            sh->store = prev;
+        }
+        free(sh->buckets);
+        pthread_mutex_destroy(&sh->lock);
+    }
+}
+
 // Comparison function for sorting
 int compare_primes(const void *a, const void *b) {
-    const BigInt *pa = (const BigInt *)a;
-    const BigInt *pb = (const BigInt *)b;
-    return mpz_cmp(pa->num, pb->num);
+    const SetNode *pa = *(const SetNode * const *)a;
+    const SetNode *pb = *(const SetNode * const *)b;
+    if (pa->size != pb->size) return pa->size < pb->size ? -1 : 1;
+    return mpn_cmp(pa->limbs, pb->limbs, pa->size);
 }
 
-void generate_number(mpz_t result, int argc, char *argv[]) {
+// Writes one random candidate into buffer; returns its digit count
+int generate_number(char *buffer, const int *max_repeats, uint64_t *rng) {
     const char *digits[] = {"13", "12", "11", "10", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
-    char buffer[200] = {0}; // Large enough to hold 32-digit numbers
+    int len = 0;
 
     for (int i = 0; i < 12; i++) {
-        int max_repeats = (i < argc-1) ? atoi(argv[i+1]) : 0; // Use ARGV if provided, else default to 2
-        int repeats = rand() % (max_repeats + 1);
+        int repeats = next_random(rng) % (max_repeats[i] + 1);
+        int token = strlen(digits[i]);
         for (int j = 0; j < repeats; j++) {
-            strcat(buffer, digits[i]);
+            // Too long to be kept anyway; keep consuming randomness
+            if (len + token <= MAX_DIGITS) {
+                memcpy(buffer + len, digits[i], token);
+            }
+            len += token;
         }
     }
 
-    mpz_set_str(result, buffer, 10);
+    buffer[len <= MAX_DIGITS ? len : 0] = '\0';
+    return len;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    printf("Usage: %s 13 12 11 10 1 2 3 4 5 6 7 8 9\n", argv[0]);
-    return 1;
-  }
-    srand(time(NULL));
-    mpz_t a;
-    mpz_init(a);
+void process_job(Worker *w, const Job *job) {
+    mpz_set_str(w->candidate, job->digits, 10);
+    if (set_contains(&w->pool->set, w->candidate)) return;
+    if (!is_probable_prime(w->candidate, &w->ps)) return;
 
-    // Initialize primes array
-    for (int i = 0; i < MAX_PRIMES; i++) {
-        mpz_init(primes[i].num);
-    }
+    bool added = set_insert(&w->pool->set, w->candidate);
+    if (added && w->out.echo) out_prime(&w->out, w->candidate);
+    // Once the set is full it can no longer tell new primes from repeats;
+    // the sink dedups those itself
+    if (w->pool->use_sink && (added || set_full(&w->pool->set))) sink_add(&w->pool->sink, w->candidate);
+}
 
-    for (int iteration = 0; iteration < 100000; iteration++) {
-        generate_number(a, argc, argv);
+// Claims a block of iterations and queues its in-range candidates locally
+bool produce_block(Worker *w) {
+    Pool *pool = w->pool;
+    // Count the block as outstanding before claiming it so no worker can
+    // see zero outstanding work while it is still being generated
+    atomic_fetch_add(&pool->outstanding, BLOCK_SIZE);
+    int start = atomic_fetch_add(&pool->next_iteration, BLOCK_SIZE);
+    if (start >= ITERATIONS) {
+        atomic_fetch_sub(&pool->outstanding, BLOCK_SIZE);
+        return false;
+    }
+    int end = start + BLOCK_SIZE < ITERATIONS ? start + BLOCK_SIZE : ITERATIONS;
 
-        // Check number of digits
-        size_t digits = mpz_sizeinbase(a, 10);
+    int skipped = BLOCK_SIZE - (end - start);
+    for (int i = start; i < end; i++) {
+        Job job;
+        int digits = generate_number(job.digits, pool->max_repeats, &w->rng);
         if (digits > MAX_DIGITS || digits < MIN_DIGITS) {
+            skipped++;
             continue;
         }
+        deque_push(&w->deque, &job);
+    }
+    atomic_fetch_sub(&pool->outstanding, skipped);
+    return true;
+}
 
-        if (is_unique_prime(a)) {
-            if (prime_count < MAX_PRIMES) {
-                mpz_set(primes[prime_count].num, a);
-                prime_count++;
-                mpz_out_str(stdout, 10, a);
-                printf("\n");
-            }
+bool steal_job(Worker *w, Job *job) {
+    Pool *pool = w->pool;
+    for (int i = 1; i < pool->worker_count; i++) {
+        Worker *victim = &pool->workers[(w->id + i) % pool->worker_count];
+        if (deque_steal(&victim->deque, job)) return true;
+    }
+    return false;
+}
+
+// Own deque first, then fresh candidates, then other workers' deques
+void *worker_main(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    Job job;
+
+    // GMP state is created on the worker's own thread so it lives in that
+    // thread's arena
+    init_prime_scratch(&w->ps, pool->extra_rounds);
+    gmp_randseed_ui(w->ps.rand, w->rng);
+    mpz_init2(w->candidate, MAX_DIGITS * 4);
+
+    for (;;) {
+        if (deque_pop(&w->deque, &job)) {
+            process_job(w, &job);
+            atomic_fetch_sub(&pool->outstanding, 1);
+            continue;
         }
+        if (produce_block(w)) continue;
+        if (steal_job(w, &job)) {
+            process_job(w, &job);
+            atomic_fetch_sub(&pool->outstanding, 1);
+            continue;
+        }
+        if (atomic_load(&pool->outstanding) == 0) break;
+        sched_yield();
+    }
+
+    out_flush(&w->out);
+    mpz_clear(w->candidate);
+    clear_prime_scratch(&w->ps);
+    if (w->id != 0) arena_release();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    // --rounds=N sets the random Miller-Rabin rounds run after BPSW,
+    // --threads=N the worker count (default: all online CPUs), --top=K and
+    // --run-size=N the bounded-memory result sinks
+    int extra_rounds = DEFAULT_EXTRA_ROUNDS;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    static Output out = {.format = FORMAT_TEXT, .echo = true};
+    int top = 0;
+    size_t run_size = 0;
+    int argn = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--rounds=", 9) == 0) {
+            extra_rounds = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--top=", 6) == 0) {
+            top = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--run-size=", 11) == 0) {
+            run_size = strtoull(argv[i] + 11, NULL, 10);
+        } else if (!parse_output_flag(argv[i], &out)) {
+            argv[argn++] = argv[i];
+        }
+    }
+    argc = argn;
+    if (threads < 1) threads = 1;
+
+  if (argc < 2) {
+    printf("Usage: %s [--rounds=N] [--threads=N] [--top=K] [--run-size=N] [--format=text|ndjson|binary] [--no-echo] 13 12 11 10 1 2 3 4 5 6 7 8 9\n", argv[0]);
+    return 1;
+  }
+    mp_set_memory_functions(arena_alloc, arena_realloc, arena_free);
+
+    Pool pool;
+    pool.extra_rounds = extra_rounds;
+    for (int i = 0; i < 12; i++) {
+        pool.max_repeats[i] = (i < argc-1) ? atoi(argv[i+1]) : 0;
+    }
+    atomic_init(&pool.next_iteration, 0);
+    atomic_init(&pool.outstanding, 0);
+    set_init(&pool.set);
+    pool.use_sink = top > 0 || run_size > 0;
+    if (pool.use_sink) sink_init(&pool.sink, top, run_size);
+
+    pool.worker_count = threads;
+    pool.workers = malloc(threads * sizeof(Worker));
+    uint64_t seed = time(NULL);
+    for (int i = 0; i < threads; i++) {
+        Worker *w = &pool.workers[i];
+        w->id = i;
+        w->rng = (seed + 1) * 0x9E3779B97F4A7C15ULL + i;
+        w->pool = &pool;
+        w->out.format = out.format;
+        w->out.echo = out.echo;
+        w->out.len = 0;
+        deque_init(&w->deque);
+    }
+
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&pool.workers[i].thread, NULL, worker_main, &pool.workers[i]);
+    }
+    worker_main(&pool.workers[0]);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(pool.workers[i].thread, NULL);
     }
 
     // Sort the primes
-    qsort(primes, prime_count, sizeof(BigInt), compare_primes);
+    size_t prime_count;
+    SetNode **primes = set_collect(&pool.set, &prime_count);
+    if (!pool.use_sink) qsort(primes, prime_count, sizeof(SetNode *), compare_primes);
 
-    // Print sorted primes
-    printf("\nSorted primes:\n");
-    for (int i = 0; i < prime_count; i++) {
-        mpz_out_str(stdout, 10, primes[i].num);
-        printf("\n");
+    // Print sorted primes. Structured formats write each prime once: as
+    // found, or with --no-echo here
+    if (!out.echo || out.format == FORMAT_TEXT) {
+        if (out.format == FORMAT_TEXT) out_str(&out, out.echo ? "\nSorted primes:\n" : "Sorted primes:\n");
+        if (pool.use_sink) {
+            sink_write(&pool.sink, &out);
+        } else {
+            for (size_t i = 0; i < prime_count; i++) {
+                mpz_t view;
+                node_view(view, primes[i]);
+                out_prime(&out, view);
+            }
+        }
     }
+    out_flush(&out);
 
     // Clean up
-    mpz_clear(a);
-    for (int i = 0; i < MAX_PRIMES; i++) {
-        mpz_clear(primes[i].num);
+    free(primes);
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&pool.workers[i].deque.lock);
     }
+    free(pool.workers);
+    set_clear(&pool.set);
+    if (pool.use_sink) sink_clear(&pool.sink);
+    arena_release();
 
     return 0;
 }
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "engine.h"
+
+#define MAX_NUMBER_DIGITS 19  // every 19-digit number fits in 64 bits
+#define DEFAULT_INDEX_CARDS 6
+#define MAX_COPIES 4          // copies of each rank in a deck
+#define TRIE_DEPTH 13         // one level per rank A..K
+#define DEFAULT_INDEX_FILE "primes.idx"
+#define INDEX_MAGIC "SOSUIDX1"
+
+typedef struct {
+    uint64_t key;             // rank counts of the prime's cards
+    unsigned long long prime;
+} IndexedPrime;
+
+// Trie over rank counts: level r-1 branches on how many copies of rank r
+// the multiset holds. Leaves (depth 13) own a run of the prime array.
+typedef struct {
+    uint32_t child[MAX_COPIES + 1]; // 0 = no child (the root is never a child)
+    uint32_t first, count;
+} IndexNode;
+
+typedef struct {
+    uint32_t max_cards;
+    IndexNode* nodes;
+    uint32_t node_count, node_capacity;
+    IndexedPrime* primes;
+    uint32_t prime_count;
+} PrimeIndex;
+
+typedef struct {
+    int counts[14];
+    int max_cards;
+    unsigned long long batch_nums[PRIME_BATCH];
+    uint64_t batch_keys[PRIME_BATCH];
+    int batch_count;
+    IndexedPrime* found;
+    size_t found_count, found_capacity;
+} Builder;
+
+static void builder_flush(Builder* b) {
+    bool prime[PRIME_BATCH];
+    is_prime_batch(b->batch_nums, b->batch_count, prime);
+    for (int i = 0; i < b->batch_count; i++) {
+        if (!prime[i]) continue;
+        if (b->found_count == b->found_capacity) {
+            b->found_capacity = b->found_capacity ? b->found_capacity * 2 : 1 << 16;
+            b->found = realloc(b->found, b->found_capacity * sizeof(IndexedPrime));
+        }
+        b->found[b->found_count++] = (IndexedPrime){b->batch_keys[i], b->batch_nums[i]};
+    }
+    b->batch_count = 0;
+}
+
+// Every distinct rank sequence of up to max_cards cards, at most
+// MAX_COPIES of each rank
+static void builder_dfs(Builder* b, int depth, unsigned long long value, int digits, uint64_t key) {
+    if (depth > 0) {
+        b->batch_nums[b->batch_count] = value;
+        b->batch_keys[b->batch_count] = key;
+        if (++b->batch_count == PRIME_BATCH) builder_flush(b);
+    }
+    if (depth == b->max_cards) return;
+    for (int r = 1; r <= 13; r++) {
+        if (b->counts[r] == MAX_COPIES) continue;
+        int len = r >= 10 ? 2 : 1;
+        if (digits + len > MAX_NUMBER_DIGITS) continue;
+        b->counts[r]++;
+        builder_dfs(b, depth + 1, value * (len == 2 ? 100 : 10) + r, digits + len, key + KEY_ONE(r));
+        b->counts[r]--;
+    }
+}
+
+// Trie order: rank A's count is the most significant digit
+static int compare_trie_order(uint64_t a, uint64_t b) {
+    for (int r = 1; r <= 13; r++) {
+        int ca = KEY_COUNT(a, r), cb = KEY_COUNT(b, r);
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return 0;
+}
+
+int compare_indexed(const void* x, const void* y) {
+    const IndexedPrime* a = x;
+    const IndexedPrime* b = y;
+    int c = compare_trie_order(a->key, b->key);
+    if (c) return c;
+    return a->prime < b->prime ? -1 : a->prime > b->prime;
+}
+
+static uint32_t new_node(PrimeIndex* idx) {
+    if (idx->node_count == idx->node_capacity) {
+        idx->node_capacity = idx->node_capacity ? idx->node_capacity * 2 : 1024;
+        idx->nodes = realloc(idx->nodes, idx->node_capacity * sizeof(IndexNode));
+    }
+    memset(&idx->nodes[idx->node_count], 0, sizeof(IndexNode));
+    return idx->node_count++;
+}
+
+void build_index(PrimeIndex* idx, int max_cards) {
+    Builder b;
+    memset(&b, 0, sizeof(b));
+    b.max_cards = max_cards;
+    builder_dfs(&b, 0, 0, 0, 0);
+    if (b.batch_count > 0) builder_flush(&b);
+
+    // Group by multiset and drop the duplicates that different card
+    // spellings of the same number produce
+    qsort(b.found, b.found_count, sizeof(IndexedPrime), compare_indexed);
+    size_t unique = 0;
+    for (size_t i = 0; i < b.found_count; i++) {
+        if (unique > 0 && b.found[unique - 1].key == b.found[i].key && b.found[unique - 1].prime == b.found[i].prime) continue;
+        b.found[unique++] = b.found[i];
+    }
+
+    memset(idx, 0, sizeof(*idx));
+    idx->max_cards = max_cards;
+    idx->primes = b.found;
+    idx->prime_count = unique;
+    new_node(idx);
+    for (size_t i = 0; i < unique;) {
+        uint64_t key = b.found[i].key;
+        size_t j = i;
+        while (j < unique && b.found[j].key == key) j++;
+
+        uint32_t node = 0;
+        for (int r = 1; r <= TRIE_DEPTH; r++) {
+            int c = KEY_COUNT(key, r);
+            if (!idx->nodes[node].child[c]) {
+                uint32_t child = new_node(idx);
+                idx->nodes[node].child[c] = child;
+            }
+            node = idx->nodes[node].child[c];
+        }
+        idx->nodes[node].first = i;
+        idx->nodes[node].count = j - i;
+        i = j;
+    }
+}
+
+bool save_index(const PrimeIndex* idx, const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return false;
+    bool ok = fwrite(INDEX_MAGIC, 1, 8, fp) == 8 &&
+              fwrite(&idx->max_cards, sizeof(uint32_t), 1, fp) == 1 &&
+              fwrite(&idx->node_count, sizeof(uint32_t), 1, fp) == 1 &&
+              fwrite(&idx->prime_count, sizeof(uint32_t), 1, fp) == 1 &&
+              fwrite(idx->nodes, sizeof(IndexNode), idx->node_count, fp) == idx->node_count &&
+              fwrite(idx->primes, sizeof(IndexedPrime), idx->prime_count, fp) == idx->prime_count;
+    return fclose(fp) == 0 && ok;
+}
+
+void free_index(PrimeIndex* idx) {
+    free(idx->nodes);
+    free(idx->primes);
+}
+
+// A file from build_index: every child link in range and used once, so
+// the trie stays a tree, and the leaf runs fit in the prime array without
+// covering more primes than it has
+static bool index_valid(const PrimeIndex* idx) {
+    if (idx->max_cards < 1 || idx->max_cards > MAX_NUMBER_DIGITS || idx->node_count == 0) return false;
+    bool* linked = calloc(idx->node_count, sizeof(bool));
+    uint64_t covered = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < idx->node_count && ok; i++) {
+        const IndexNode* n = &idx->nodes[i];
+        for (int c = 0; c <= MAX_COPIES && ok; c++) {
+            uint32_t child = n->child[c];
+            if (!child) continue;
+            ok = child < idx->node_count && !linked[child];
+            if (ok) linked[child] = true;
+        }
+        covered += n->count;
+        ok = ok && (uint64_t)n->first + n->count <= idx->prime_count && covered <= idx->prime_count;
+    }
+    free(linked);
+    return ok;
+}
+
+bool load_index(PrimeIndex* idx, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    char magic[8];
+    memset(idx, 0, sizeof(*idx));
+    bool ok = fread(magic, 1, 8, fp) == 8 && memcmp(magic, INDEX_MAGIC, 8) == 0 &&
+              fread(&idx->max_cards, sizeof(uint32_t), 1, fp) == 1 &&
+              fread(&idx->node_count, sizeof(uint32_t), 1, fp) == 1 &&
+              fread(&idx->prime_count, sizeof(uint32_t), 1, fp) == 1;
+    if (ok) {
+        idx->nodes = malloc((idx->node_count ? idx->node_count : 1) * sizeof(IndexNode));
+        idx->primes = malloc((idx->prime_count ? idx->prime_count : 1) * sizeof(IndexedPrime));
+        ok = fread(idx->nodes, sizeof(IndexNode), idx->node_count, fp) == idx->node_count &&
+             fread(idx->primes, sizeof(IndexedPrime), idx->prime_count, fp) == idx->prime_count &&
+             index_valid(idx);
+    }
+    fclose(fp);
+    if (!ok) free_index(idx);
+    return ok;
+}
+
+// Containment query: at each level follow only the counts the hand can
+// cover, collecting the primes of every leaf reached
+static void query_node(const PrimeIndex* idx, uint32_t node, int rank, const int* counts,
+                       const IndexedPrime** out, size_t* out_count) {
+    const IndexNode* n = &idx->nodes[node];
+    if (rank > TRIE_DEPTH) {
+        for (uint32_t i = 0; i < n->count; i++) out[(*out_count)++] = &idx->primes[n->first + i];
+        return;
+    }
+    int limit = counts[rank] < MAX_COPIES ? counts[rank] : MAX_COPIES;
+    for (int c = 0; c <= limit; c++) {
+        if (n->child[c]) query_node(idx, n->child[c], rank + 1, counts, out, out_count);
+    }
+}
+
+int compare_desc(const void* x, const void* y) {
+    const IndexedPrime* a = *(const IndexedPrime* const*)x;
+    const IndexedPrime* b = *(const IndexedPrime* const*)y;
+    return a->prime < b->prime ? 1 : a->prime > b->prime ? -1 : 0;
+}
+
+void run_query(const PrimeIndex* idx, const char* hand, const IndexedPrime** out) {
+    int counts[14] = {0};
+    for (const char* p = hand; *p; p++) {
+        int r = parse_card(*p);
+        if (r > 0) counts[r]++;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t count = 0;
+    query_node(idx, 0, 1, counts, out, &count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    qsort(out, count, sizeof(*out), compare_desc);
+    printf("# %s: %zu\n", hand, count);
+    for (size_t i = 0; i < count; i++) {
+        printf("%llu ", out[i]->prime);
+        print_key(out[i]->key);
+        printf("\n");
+    }
+    fprintf(stderr, "%s: %zu primes in %.3f ms\n", hand, count,
+            (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "build") == 0) {
+        int max_cards = argc >= 3 ? atoi(argv[2]) : DEFAULT_INDEX_CARDS;
+        const char* path = argc >= 4 ? argv[3] : DEFAULT_INDEX_FILE;
+        if (max_cards < 1 || max_cards > MAX_NUMBER_DIGITS) {
+            fprintf(stderr, "k must be 1..%d\n", MAX_NUMBER_DIGITS);
+            return 1;
+        }
+        PrimeIndex idx;
+        build_index(&idx, max_cards);
+        if (!save_index(&idx, path)) {
+            perror(path);
+            return 1;
+        }
+        fprintf(stderr, "%u primes, %u trie nodes -> %s\n", idx.prime_count, idx.node_count, path);
+        free_index(&idx);
+        return 0;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "query") == 0) {
+        PrimeIndex idx;
+        if (!load_index(&idx, argv[2])) {
+            fprintf(stderr, "%s: not a prime index\n", argv[2]);
+            return 1;
+        }
+        const IndexedPrime** out = malloc((idx.prime_count ? idx.prime_count : 1) * sizeof(*out));
+        if (argc >= 4) {
+            for (int i = 3; i < argc; i++) run_query(&idx, argv[i], out);
+        } else {
+            char line[256];
+            while (fgets(line, sizeof(line), stdin)) {
+                line[strcspn(line, "\r\n")] = '\0';
+                if (line[0]) run_query(&idx, line, out);
+            }
+        }
+        free(out);
+        free_index(&idx);
+        return 0;
+    }
+
+    fprintf(stderr, "素数索引:\n");
+    fprintf(stderr, "Usage: %s build [k] [file]\n", argv[0]);
+    fprintf(stderr, "       %s query file [カード...]\n", argv[0]);
+    return 1;
+}
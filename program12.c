@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+#define MAX_NUMBER_DIGITS 19  // every 19-digit number fits in 64 bits
+#define MAX_ENDGAME_CARDS 10  // per hand; move lists grow with k!
+#define DEFAULT_TT_MB 64
+
+#define KEY_HIGH_BITS 0x8888888888888888ULL
+
+// Two-player endgame: players alternately play a prime made of some of
+// their cards; on a non-empty table it must use as many cards as the
+// table and be larger. Passing clears the table and the other player
+// leads. Emptying your hand wins. Values are from the side to move:
+// +1 forced win, -1 forced loss, 0 neither can ever lead (draw).
+
+// A play: the cards used and the prime they spell
+typedef struct {
+    uint64_t key;
+    unsigned long long prime;
+    int cards;
+} Move;
+
+// Every prime each hand can ever play, sorted by (cards, prime)
+typedef struct {
+    Move* moves;
+    int count, capacity;
+    int by_cards[MAX_NUMBER_DIGITS + 2];   // first move with this many cards
+} MoveList;
+
+// Transposition table entries are written without locks: check holds
+// hash ^ data, so a torn entry just fails the check
+typedef struct {
+    _Atomic uint64_t check, data;
+} TTEntry;
+
+enum { TT_EXACT = 1, TT_LOWER = 2, TT_UPPER = 3 };
+
+typedef struct {
+    MoveList lists[2];
+    TTEntry* tt;
+    uint64_t tt_mask;
+    uint64_t zobrist[2][14][16];
+    uint64_t zobrist_turn;
+    atomic_bool stop;            // a root move already wins
+} Solver;
+
+typedef struct RootSearch RootSearch;
+
+typedef struct {
+    Solver* solver;
+    RootSearch* root;
+    unsigned long long nodes, tt_hits;
+    pthread_t thread;
+} SearchThread;
+
+// Subset test on packed counts: with at most 7 copies a rank, setting each
+// nibble's high bit keeps the subtraction from borrowing across ranks
+static inline bool key_contains(uint64_t hand, uint64_t key) {
+    return (((hand | KEY_HIGH_BITS) - key) & KEY_HIGH_BITS) == KEY_HIGH_BITS;
+}
+
+static uint64_t table_hash(int cards, unsigned long long value) {
+    uint64_t state = value * 32 + cards;
+    return cards ? splitmix(&state) : 0;
+}
+
+static uint64_t hand_hash(const Solver* s, int player, uint64_t key) {
+    uint64_t h = 0;
+    for (int r = 1; r <= 13; r++) h ^= s->zobrist[player][r][KEY_COUNT(key, r)];
+    return h;
+}
+
+// Only the ranks a play touches change the hash
+static uint64_t hash_after_play(const Solver* s, int player, uint64_t hand, uint64_t key) {
+    uint64_t h = 0;
+    for (int r = 1; r <= 13; r++) {
+        int used = KEY_COUNT(key, r);
+        if (!used) continue;
+        int had = KEY_COUNT(hand, r);
+        h ^= s->zobrist[player][r][had] ^ s->zobrist[player][r][had - used];
+    }
+    return h;
+}
+
+// Move generation: every distinct arrangement of every sub-multiset,
+// tested in batches
+typedef struct {
+    MoveList* list;
+    int left[14];
+    unsigned long long batch_nums[PRIME_BATCH];
+    uint64_t key;
+    int cards;
+    int batch_count;
+} MoveBuilder;
+
+static void builder_flush(MoveBuilder* b) {
+    bool prime[PRIME_BATCH];
+    is_prime_batch(b->batch_nums, b->batch_count, prime);
+    MoveList* list = b->list;
+    for (int i = 0; i < b->batch_count; i++) {
+        if (!prime[i]) continue;
+        if (list->count == list->capacity) {
+            list->capacity = list->capacity ? list->capacity * 2 : 256;
+            list->moves = realloc(list->moves, list->capacity * sizeof(Move));
+        }
+        list->moves[list->count++] = (Move){b->key, b->batch_nums[i], b->cards};
+    }
+    b->batch_count = 0;
+}
+
+static void arrange(MoveBuilder* b, int remaining, unsigned long long value) {
+    if (remaining == 0) {
+        b->batch_nums[b->batch_count] = value;
+        if (++b->batch_count == PRIME_BATCH) builder_flush(b);
+        return;
+    }
+    for (int r = 1; r <= 13; r++) {
+        if (b->left[r] == 0) continue;
+        b->left[r]--;
+        arrange(b, remaining - 1, value * (r >= 10 ? 100 : 10) + r);
+        b->left[r]++;
+    }
+}
+
+static void subsets(MoveBuilder* b, uint64_t hand, int rank, int digits) {
+    if (rank > 13) {
+        if (!b->key) return;
+        for (int r = 1; r <= 13; r++) b->left[r] = KEY_COUNT(b->key, r);
+        arrange(b, b->cards, 0);
+        if (b->batch_count > 0) builder_flush(b);
+        return;
+    }
+    int len = rank >= 10 ? 2 : 1;
+    for (int n = 0; n <= KEY_COUNT(hand, rank); n++) {
+        if (digits + n * len > MAX_NUMBER_DIGITS) break;
+        b->key += n * KEY_ONE(rank);
+        b->cards += n;
+        subsets(b, hand, rank + 1, digits + n * len);
+        b->key -= n * KEY_ONE(rank);
+        b->cards -= n;
+    }
+}
+
+int compare_moves(const void* x, const void* y) {
+    const Move* a = x;
+    const Move* b = y;
+    if (a->cards != b->cards) return a->cards - b->cards;
+    if (a->prime != b->prime) return a->prime < b->prime ? -1 : 1;
+    return a->key < b->key ? -1 : a->key > b->key;
+}
+
+void build_moves(MoveList* list, uint64_t hand) {
+    MoveBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.list = list;
+    subsets(&b, hand, 1, 0);
+    qsort(list->moves, list->count, sizeof(Move), compare_moves);
+    // [1,11] and [11,1] are the same play; 111 from AAA and from AJ are not
+    int unique = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (unique > 0 && compare_moves(&list->moves[unique - 1], &list->moves[i]) == 0) continue;
+        list->moves[unique++] = list->moves[i];
+    }
+    list->count = unique;
+    int i = 0;
+    for (int k = 0; k <= MAX_NUMBER_DIGITS + 1; k++) {
+        while (i < list->count && list->moves[i].cards < k) i++;
+        list->by_cards[k] = i;
+    }
+}
+
+// Can this hand play anything at all on an empty table?
+static bool can_lead(const MoveList* list, uint64_t hand) {
+    for (int i = 0; i < list->count; i++) {
+        if (key_contains(hand, list->moves[i].key)) return true;
+    }
+    return false;
+}
+
+static bool tt_probe(const Solver* s, uint64_t hash, int* value, int* flag, int* best) {
+    const TTEntry* e = &s->tt[hash & s->tt_mask];
+    uint64_t data = atomic_load_explicit(&e->data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&e->check, memory_order_relaxed);
+    if ((check ^ data) != hash || !data) return false;
+    *value = (int)(data & 3) - 1;
+    *flag = (int)(data >> 2) & 3;
+    *best = (int)(data >> 4) - 1;
+    return true;
+}
+
+static void tt_store(Solver* s, uint64_t hash, int value, int flag, int best) {
+    TTEntry* e = &s->tt[hash & s->tt_mask];
+    uint64_t data = (uint64_t)(value + 1) | (uint64_t)flag << 2 | (uint64_t)(best + 1) << 4;
+    atomic_store_explicit(&e->data, data, memory_order_relaxed);
+    atomic_store_explicit(&e->check, hash ^ data, memory_order_relaxed);
+}
+
+// Negamax with alpha-beta over {-1, 0, +1}; hands[p] is to move. The
+// table keeps each position's bound and best move (-1 for a pass).
+static int solve(SearchThread* t, const uint64_t* hands, int p, int table_cards, unsigned long long table_value,
+                 uint64_t hash, int alpha, int beta) {
+    Solver* s = t->solver;
+    if (atomic_load_explicit(&s->stop, memory_order_relaxed)) return 0;
+    t->nodes++;
+
+    int orig_alpha = alpha;
+    int tt_value, tt_flag, tt_best = -1;
+    if (tt_probe(s, hash, &tt_value, &tt_flag, &tt_best)) {
+        t->tt_hits++;
+        if (tt_flag == TT_EXACT) return tt_value;
+        if (tt_flag == TT_LOWER && tt_value > alpha) alpha = tt_value;
+        if (tt_flag == TT_UPPER && tt_value < beta) beta = tt_value;
+        if (alpha >= beta) return tt_value;
+    }
+
+    const MoveList* list = &s->lists[p];
+    uint64_t mine = hands[p];
+    uint64_t next[2];
+    uint64_t hash_turn = hash ^ s->zobrist_turn ^ table_hash(table_cards, table_value);
+    int best = -2, best_move = -1;
+
+    // Legal plays: on a table, exactly table_cards cards and a larger
+    // prime; leading, anything, most cards first. The table entry's best
+    // move is tried before the rest.
+    int first, last, step;
+    if (table_cards) {
+        first = list->by_cards[table_cards];
+        last = list->by_cards[table_cards + 1];
+        while (first < last && list->moves[first].prime <= table_value) first++;
+        step = 1;
+    } else {
+        first = list->count - 1;
+        last = -1;
+        step = -1;
+    }
+    bool any = false;
+    for (int n = -1;; n++) {
+        int i = first + n * step;
+        if (n < 0) {
+            if (tt_best < 0 || tt_best >= list->count) continue;
+            i = tt_best;
+        } else if (i == last) {
+            break;
+        } else if (i == tt_best) {
+            continue;
+        }
+        const Move* m = &list->moves[i];
+        if (!key_contains(mine, m->key)) continue;
+        if (table_cards && (m->cards != table_cards || m->prime <= table_value)) continue;
+        any = true;
+        int v = 1;
+        if (m->key != mine) {
+            next[p] = mine - m->key;
+            next[!p] = hands[!p];
+            uint64_t h = hash_turn ^ hash_after_play(s, p, mine, m->key) ^ table_hash(m->cards, m->prime);
+            v = -solve(t, next, !p, m->cards, m->prime, h, -beta, -alpha);
+            if (atomic_load_explicit(&s->stop, memory_order_relaxed)) return 0;
+        }
+        if (v > best) {
+            best = v;
+            best_move = i;
+        }
+        if (v > alpha) alpha = v;
+        if (alpha >= beta) goto done;
+    }
+
+    // Passing: always allowed on a table; a leader may pass only with
+    // nothing to play, and if neither side can lead nobody ever will
+    if (table_cards || !any) {
+        int v;
+        if (!table_cards && !can_lead(&s->lists[!p], hands[!p])) {
+            v = 0;
+        } else {
+            v = -solve(t, hands, !p, 0, 0, hash_turn, -beta, -alpha);
+            if (atomic_load_explicit(&s->stop, memory_order_relaxed)) return 0;
+        }
+        if (v > best) {
+            best = v;
+            best_move = -1;
+        }
+    }
+
+done:
+    tt_store(s, hash, best, best <= orig_alpha ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT, best_move);
+    return best;
+}
+
+typedef struct {
+    int move;                    // index into the mover's list, -1 for a pass
+    int value;
+    bool done;
+} RootMove;
+
+struct RootSearch {
+    uint64_t hands[2];
+    int table_cards;
+    unsigned long long table_value;
+    uint64_t hash;
+    RootMove* moves;
+    int count;
+    atomic_int next;
+};
+
+// Root moves are handed out one at a time; the first forced win stops
+// every other thread
+void* root_worker(void* arg) {
+    SearchThread* t = arg;
+    Solver* s = t->solver;
+    RootSearch* root = t->root;
+    const MoveList* list = &s->lists[0];
+    uint64_t hash_turn = root->hash ^ s->zobrist_turn ^ table_hash(root->table_cards, root->table_value);
+    for (;;) {
+        int j = atomic_fetch_add(&root->next, 1);
+        if (j >= root->count || atomic_load(&s->stop)) break;
+        RootMove* rm = &root->moves[j];
+        int v;
+        if (rm->move < 0) {
+            v = root->table_cards || can_lead(&s->lists[1], root->hands[1])
+                ? -solve(t, root->hands, 1, 0, 0, hash_turn, -1, 1) : 0;
+        } else {
+            const Move* m = &list->moves[rm->move];
+            uint64_t next[2] = {root->hands[0] - m->key, root->hands[1]};
+            if (!next[0]) {
+                v = 1;
+            } else {
+                uint64_t h = hash_turn ^ hash_after_play(s, 0, root->hands[0], m->key) ^ table_hash(m->cards, m->prime);
+                v = -solve(t, next, 1, m->cards, m->prime, h, -1, 1);
+            }
+        }
+        if (atomic_load(&s->stop)) break;
+        rm->value = v;
+        rm->done = true;
+        if (v == 1) atomic_store(&s->stop, true);
+    }
+    return NULL;
+}
+
+static uint64_t parse_hand(const char* text, int* cards, int* digits) {
+    uint64_t key = 0;
+    *cards = 0;
+    *digits = 0;
+    for (const char* p = text; *p; p++) {
+        int r = parse_card(*p);
+        if (r <= 0) continue;
+        if (KEY_COUNT(key, r) == 7) return 0;
+        key += KEY_ONE(r);
+        (*cards)++;
+        *digits += r >= 10 ? 2 : 1;
+    }
+    return key;
+}
+
+int main(int argc, char** argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int tt_mb = DEFAULT_TT_MB;
+    const char* table_text = "";
+    const char* texts[2] = {NULL, NULL};
+    int text_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--table=", 8) == 0) {
+            table_text = argv[i] + 8;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--tt-mb=", 8) == 0) {
+            tt_mb = atoi(argv[i] + 8);
+        } else if (text_count < 2) {
+            texts[text_count++] = argv[i];
+        }
+    }
+    if (text_count < 2) {
+        fprintf(stderr, "終盤解析:\n");
+        fprintf(stderr, "Usage: %s [--table=場のカード] [--threads=N] [--tt-mb=M] 手番の手札 相手の手札\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (tt_mb < 1) tt_mb = 1;
+
+    static Solver s;
+    RootSearch root;
+    memset(&root, 0, sizeof(root));
+    for (int p = 0; p < 2; p++) {
+        int cards, digits;
+        root.hands[p] = parse_hand(texts[p], &cards, &digits);
+        if (!root.hands[p] || cards > MAX_ENDGAME_CARDS) {
+            fprintf(stderr, "%s: 手札は1〜%d枚 (同じカードは7枚まで)\n", texts[p], MAX_ENDGAME_CARDS);
+            return 1;
+        }
+        // Moves are 64-bit values, so a longer play could never be tested
+        if (digits > MAX_NUMBER_DIGITS) {
+            fprintf(stderr, "%s: 手札は%d桁まで\n", texts[p], MAX_NUMBER_DIGITS);
+            return 1;
+        }
+    }
+    int table[MAX_NUMBER_DIGITS];
+    int table_digits = 0;
+    for (const char* p = table_text; *p; p++) {
+        int r = parse_card(*p);
+        if (r <= 0) continue;
+        table_digits += r >= 10 ? 2 : 1;
+        if (table_digits > MAX_NUMBER_DIGITS) {
+            fprintf(stderr, "%s: 場のカードは%d桁まで\n", table_text, MAX_NUMBER_DIGITS);
+            return 1;
+        }
+        table[root.table_cards++] = r;
+    }
+    root.table_value = cards_value(table, root.table_cards);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int p = 0; p < 2; p++) build_moves(&s.lists[p], root.hands[p]);
+    double build_ms = elapsed_ms(&start);
+
+    uint64_t seed = 0x50535544ULL;
+    for (int p = 0; p < 2; p++) {
+        for (int r = 0; r < 14; r++) {
+            for (int c = 0; c < 16; c++) s.zobrist[p][r][c] = splitmix(&seed);
+        }
+    }
+    s.zobrist_turn = splitmix(&seed);
+    size_t entries = 1;
+    while (entries * 2 * sizeof(TTEntry) <= (size_t)tt_mb << 20) entries *= 2;
+    s.tt = calloc(entries, sizeof(TTEntry));
+    s.tt_mask = entries - 1;
+    root.hash = hand_hash(&s, 0, root.hands[0]) ^ hand_hash(&s, 1, root.hands[1]) ^
+                table_hash(root.table_cards, root.table_value);
+
+    // Root moves in the order the search would try them
+    const MoveList* list = &s.lists[0];
+    root.moves = malloc((list->count + 1) * sizeof(RootMove));
+    for (int i = list->count - 1; i >= 0; i--) {
+        const Move* m = &list->moves[i];
+        if (!key_contains(root.hands[0], m->key)) continue;
+        if (root.table_cards && (m->cards != root.table_cards || m->prime <= root.table_value)) continue;
+        root.moves[root.count++] = (RootMove){i, 0, false};
+    }
+    if (root.table_cards || root.count == 0) root.moves[root.count++] = (RootMove){-1, 0, false};
+
+    SearchThread* workers = calloc(threads, sizeof(SearchThread));
+    for (int t = 0; t < threads; t++) {
+        workers[t].solver = &s;
+        workers[t].root = &root;
+    }
+    for (int t = 1; t < threads; t++) pthread_create(&workers[t].thread, NULL, root_worker, &workers[t]);
+    root_worker(&workers[0]);
+    unsigned long long nodes = workers[0].nodes, tt_hits = workers[0].tt_hits;
+    for (int t = 1; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        nodes += workers[t].nodes;
+        tt_hits += workers[t].tt_hits;
+    }
+
+    // Best root move: a win if any, else a draw, else the first loss
+    int best = -1;
+    for (int j = 0; j < root.count; j++) {
+        if (root.moves[j].done && (best < 0 || root.moves[j].value > root.moves[best].value)) best = j;
+    }
+    int value = root.moves[best].value;
+    printf("%s\n", value > 0 ? "必勝" : value < 0 ? "必敗" : "引き分け");
+    if (root.moves[best].move < 0) {
+        printf("最善手: パス\n");
+    } else {
+        const Move* m = &list->moves[root.moves[best].move];
+        printf("最善手: %llu (", m->prime);
+        print_key(m->key);
+        printf(")\n");
+    }
+    fprintf(stderr, "%d + %d plays cached in %.2f ms, %llu nodes (%llu table hits) in %.2f ms\n",
+            s.lists[0].count, s.lists[1].count, build_ms, nodes, tt_hits, elapsed_ms(&start) - build_ms);
+
+    free(workers);
+    free(root.moves);
+    free(s.tt);
+    for (int p = 0; p < 2; p++) free(s.lists[p].moves);
+    return 0;
+}
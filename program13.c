@@ -0,0 +1,1739 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <gmp.h>
+
+#include "engine.h"
+#include "engine_limbs.h"
+
+// Primality certificates for the big probable primes program.c finds.
+// Each line proves one number from numbers proved on earlier lines;
+// anything below 2^64 comes from the deterministic test in the engine.
+//
+//   N1 n q:a q:a ...    Pocklington, or BLS75 theorem 5 with m = 1: the q
+//                       divide n-1 (F is their full powers), a is the
+//                       witness for q
+//   EC n A B m q x y    Goldwasser-Kilian: (x, y) on y^2 = x^3 + Ax + B,
+//                       [m/q]P != O, [q][m/q]P = O, q > (n^(1/4) + 1)^2
+//   # n                 n is claimed prime; the lines above prove it
+//
+// n-1 is tried first. When it cannot be factored far enough, the curve
+// orders of small class number CM fields give more candidates
+// (Atkin-Morain), and the search backtracks over them. When none of those
+// lead anywhere the search backs off: class numbers up to EXTRA_CLASS,
+// whose polynomials are computed from the reduced forms, then more rho on
+// every order and more curves per order. A number can still end up
+// unproved: none of 16,000 card-digit primes of 30 to 90 digits did,
+// against about 1 in 350 without the back-off.
+
+#define TRIAL_LIMIT (1 << 20)
+#define TRIAL_SMALL 1024           // above this a piece below TRIAL_LIMIT is prime
+#define RHO_BUDGET_NM1 (1 << 14)   // rho steps spent on what is left of n-1
+#define RHO_BUDGET_ORDER (1 << 12) // and on each curve order
+#define RHO_BUDGET_BACKOFF (1 << 16) // the most the back-off spends per order
+#define RHO_TRIES 3
+#define CURVE_TRIES 24
+#define CURVE_TRIES_BACKOFF 96
+#define POINT_TRIES 2
+#define MAX_WITNESS 1000
+#define MAX_TOKENS 512            // per certificate line
+
+typedef struct {
+    mpz_t prime;
+    unsigned long exponent;
+} Factor;
+
+typedef struct {
+    Factor *factors;
+    size_t count;
+    size_t capacity;
+} Factorization;
+
+// CM discriminants of class number at most 3 (and the orders -12, -16,
+// -27, -28), each with its Hilbert class polynomial: monic, the rest of
+// the coefficients lowest first. A root mod n is a j-invariant of a curve
+// with CM by that order; it exists when 4n = u^2 + |d|v^2 can be solved.
+#define MAX_CLASS 3
+
+static const struct {
+    int d;
+    const char *h[MAX_CLASS];
+} CM_FIELDS[] = {
+    {-3, {"0"}},
+    {-4, {"-1728"}},
+    {-7, {"3375"}},
+    {-8, {"-8000"}},
+    {-11, {"32768"}},
+    {-12, {"-54000"}},
+    {-16, {"-287496"}},
+    {-19, {"884736"}},
+    {-27, {"12288000"}},
+    {-28, {"-16581375"}},
+    {-43, {"884736000"}},
+    {-67, {"147197952000"}},
+    {-163, {"262537412640768000"}},
+    {-15, {"-121287375", "191025"}},
+    {-20, {"-681472000", "-1264000"}},
+    {-24, {"14670139392", "-4834944"}},
+    {-35, {"-134217728000", "117964800"}},
+    {-40, {"9103145472000", "-425692800"}},
+    {-51, {"6262062317568", "5541101568"}},
+    {-52, {"-567663552000000", "-6896880000"}},
+    {-88, {"15798135578688000000", "-6294842640000"}},
+    {-91, {"-3845689020776448", "10359073013760"}},
+    {-115, {"130231327260672000", "427864611225600"}},
+    {-123, {"148809594175488000000", "1354146840576000"}},
+    {-148, {"-7898242515936467904000000", "-39660183801072000"}},
+    {-187, {"-3845689020776448000000", "4545336381788160000"}},
+    {-232, {"14871070713157137145512000000000", "-604729957849891344000"}},
+    {-235, {"11946621170462723407872000", "823177419449425920000"}},
+    {-267, {"531429662672621376897024000000", "19683091854079488000000"}},
+    {-403, {"-108844203402491055833088000000", "2452811389229331391979520000"}},
+    {-427, {"155041756222618916546936832000000", "15611455512523783919812608000"}},
+    {-23, {"12771880859375", "-5151296875", "3491750"}},
+    {-31, {"1566028350940383", "-58682638134", "39491307"}},
+    {-59, {"374643194001883136", "-140811576541184", "30197678080"}},
+    {-83, {"549755813888000000000", "-41490055168000000", "2691907584000"}},
+    {-107, {"337618789203968000000000", "-6764523159552000000", "129783279616000"}},
+    {-139, {"67408489017571610198016", "-53041786755137667072", "12183160834031616"}},
+    {-211, {"5310823021408898698117644288", "277390576406111100862464", "65873587288630099968"}},
+    {-283, {"201371843156955365376000000000", "90839236535446929408000000", "89611323386832801792000"}},
+    {-307, {"8987619631060626702336000000000", "-5083646425734146162688000000", "805016812009981390848000"}},
+    {-331, {"56176242840389398230218488594563072", "368729929041040103875232661504", "6647404730173793386463232"}},
+    {-379, {"15443600047689011948024601807415148544", "-121567791009880876719538528321536", "364395404104624239018246144"}},
+    {-499, {"4671133182399954782798673154437441310949376", "-6063717825494266394722392560011051008", "3005101108071026200706725969920"}},
+    {-547, {"83303937570678403968635240448000000000", "-139712328431787827943469744128000000", "81297395539631654721637478400000"}},
+    {-643, {"308052554652302847380880841299197952000000000", "-6300378505047247876499651797450752000000", "39545575162726134099492467011584000"}},
+    {-883, {"167990285381627318187575520800123387904000000000", "-151960111125245282033875619529124478976000000", "34903934341011819039224295011933392896000"}},
+    {-907, {"149161274746524841328545894969274007552000000000", "39181594208014819617565811575376314368000000", "123072080721198402394477590506838687744000"}},
+};
+#define CM_COUNT (int)(sizeof(CM_FIELDS) / sizeof(CM_FIELDS[0]))
+
+// Back-off fields: every other discriminant of class number up to
+// EXTRA_CLASS (none is below -6307), numbered from CM_COUNT on. Their
+// polynomials are computed the first time a curve is needed.
+#define EXTRA_CLASS 8
+#define EXTRA_DISC 6400
+#define MAX_EXTRA_ORDERS 128
+
+typedef struct {
+    int d;
+    int degree;         // the class number
+    mpz_t *h;           // as in CM_FIELDS; NULL until computed
+} ExtraField;
+
+static ExtraField *extra_fields;
+static int extra_count = -1;    // -1 until listed
+
+#define MAX_ORDERS (CM_COUNT * 2 + 6 + MAX_EXTRA_ORDERS)  // j = 0 has six twists, j = 1728 four
+
+// Numbers to factor for one n: x[0] = n-1, then the curve orders. Trial
+// division strips x[i] down to its cofactor; m keeps the original.
+typedef struct {
+    int count;
+    mpz_t x[MAX_ORDERS + 1];
+    mpz_t m[MAX_ORDERS + 1];
+    Factorization f[MAX_ORDERS + 1];
+    int field[MAX_ORDERS + 1];
+    bool tried[MAX_ORDERS + 1];
+} Candidates;
+
+// m = k * q with q a probable prime large enough to prove n
+typedef struct {
+    int index;          // into Candidates
+    int field;
+    mpz_t m, q;
+} Order;
+
+enum { PROOF_UNKNOWN, PROOF_RUNNING, PROOF_DONE, PROOF_FAILED };
+
+typedef struct {
+    mpz_t n;
+    int state;
+    char *line;
+    int *children;
+    int child_count;
+    bool emitted;
+    Candidates *cand;   // set for inputs, trial divided together
+} Proof;
+
+// Every number met so far, looked up by value
+typedef struct {
+    Proof *proofs;
+    int count, capacity;
+    int *slots;         // proof index + 1, 0 = empty
+    size_t slot_capacity;
+} Registry;
+
+typedef struct {
+    mpz_t *level[64];
+    size_t size[64];
+    int depth;
+} Tree;
+
+static uint32_t *trial_primes;
+static size_t trial_count, small_count;
+static mpz_t trial_product;
+static gmp_randstate_t rng;
+static unsigned long long rho_steps, curves_tried;
+
+void init_factorization(Factorization *f) {
+    f->factors = NULL;
+    f->count = 0;
+    f->capacity = 0;
+}
+
+void add_factor(Factorization *f, const mpz_t prime, unsigned long exponent) {
+    if (f->count == f->capacity) {
+        f->capacity = f->capacity ? f->capacity * 2 : 8;
+        f->factors = realloc(f->factors, f->capacity * sizeof(Factor));
+    }
+    mpz_init_set(f->factors[f->count].prime, prime);
+    f->factors[f->count].exponent = exponent;
+    f->count++;
+}
+
+void clear_factorization(Factorization *f) {
+    for (size_t i = 0; i < f->count; i++) mpz_clear(f->factors[i].prime);
+    free(f->factors);
+    init_factorization(f);
+}
+
+int compare_factors(const void *a, const void *b) {
+    return mpz_cmp(((const Factor *)a)->prime, ((const Factor *)b)->prime);
+}
+
+// Deterministic below 2^64, Baillie-PSW (plus GMP's rounds) above
+bool probable_prime(const mpz_t n) {
+    if (mpz_sgn(n) <= 0) return false;
+    if (mpz_fits_ulong_p(n)) return is_prime(mpz_get_ui(n));
+    if (limbs_fit(n)) return limbs_bpsw(n);
+    return mpz_probab_prime_p(n, 25) > 0;
+}
+
+// Below 2^64 the engine's answer is already a proof
+static bool small_number(const mpz_t n) {
+    return mpz_sizeinbase(n, 2) <= 64;
+}
+
+// Product tree: level 0 holds the leaves, the last level their product
+void tree_build(Tree *t, mpz_t *const *leaves, size_t count) {
+    t->depth = 0;
+    t->size[0] = count;
+    t->level[0] = malloc(count * sizeof(mpz_t));
+    for (size_t i = 0; i < count; i++) mpz_init_set(t->level[0][i], *leaves[i]);
+    while (t->size[t->depth] > 1) {
+        size_t below = t->size[t->depth], size = (below + 1) / 2;
+        mpz_t *lo = t->level[t->depth];
+        mpz_t *hi = malloc(size * sizeof(mpz_t));
+        for (size_t i = 0; i < below / 2; i++) {
+            mpz_init(hi[i]);
+            mpz_mul(hi[i], lo[2 * i], lo[2 * i + 1]);
+        }
+        if (below % 2) mpz_init_set(hi[size - 1], lo[below - 1]);
+        t->depth++;
+        t->level[t->depth] = hi;
+        t->size[t->depth] = size;
+    }
+}
+
+void tree_clear(Tree *t) {
+    for (int d = 0; d <= t->depth; d++) {
+        for (size_t i = 0; i < t->size[d]; i++) mpz_clear(t->level[d][i]);
+        free(t->level[d]);
+    }
+}
+
+// y mod every leaf, reduced down the tree
+mpz_t *tree_remainders(const Tree *t, const mpz_t y) {
+    mpz_t *above = malloc(sizeof(mpz_t));
+    mpz_init(above[0]);
+    mpz_mod(above[0], y, t->level[t->depth][0]);
+    for (int d = t->depth - 1; d >= 0; d--) {
+        mpz_t *below = malloc(t->size[d] * sizeof(mpz_t));
+        for (size_t i = 0; i < t->size[d]; i++) {
+            mpz_init(below[i]);
+            mpz_mod(below[i], above[i / 2], t->level[d][i]);
+        }
+        for (size_t i = 0; i < t->size[d + 1]; i++) mpz_clear(above[i]);
+        free(above);
+        above = below;
+    }
+    return above;
+}
+
+void init_trial_primes(void) {
+    char *composite = calloc(TRIAL_LIMIT, 1);
+    trial_primes = malloc(TRIAL_LIMIT / 8 * sizeof(uint32_t));
+    for (uint32_t i = 2; i < TRIAL_LIMIT; i++) {
+        if (composite[i]) continue;
+        if (i < TRIAL_SMALL) small_count++;
+        trial_primes[trial_count++] = i;
+        for (uint64_t j = (uint64_t)i * i; j < TRIAL_LIMIT; j += i) composite[j] = 1;
+    }
+    free(composite);
+
+    mpz_t *leaves = malloc(trial_count * sizeof(mpz_t));
+    mpz_t **refs = malloc(trial_count * sizeof(mpz_t *));
+    for (size_t i = 0; i < trial_count; i++) {
+        mpz_init_set_ui(leaves[i], trial_primes[i]);
+        refs[i] = &leaves[i];
+    }
+    Tree t;
+    tree_build(&t, refs, trial_count);
+    mpz_init_set(trial_product, t.level[t.depth][0]);
+    tree_clear(&t);
+    for (size_t i = 0; i < trial_count; i++) mpz_clear(leaves[i]);
+    free(leaves);
+    free(refs);
+}
+
+// Pollard-Brent rho with a step budget; d gets a nontrivial factor of n
+bool rho(mpz_t d, const mpz_t n, unsigned long c, unsigned long budget) {
+    mpz_t x, y, ys, q, t;
+    mpz_inits(x, y, ys, q, t, NULL);
+    mpz_set_ui(y, 2);
+    mpz_set_ui(q, 1);
+    mpz_set_ui(d, 1);
+    unsigned long steps = 0;
+    for (unsigned long r = 1; mpz_cmp_ui(d, 1) == 0 && steps < budget; r *= 2) {
+        mpz_set(x, y);
+        for (unsigned long i = 0; i < r; i++) {
+            mpz_mul(y, y, y);
+            mpz_add_ui(y, y, c);
+            mpz_mod(y, y, n);
+        }
+        for (unsigned long k = 0; k < r && mpz_cmp_ui(d, 1) == 0; k += 128) {
+            mpz_set(ys, y);
+            for (unsigned long i = 0; i < 128 && i < r - k; i++) {
+                mpz_mul(y, y, y);
+                mpz_add_ui(y, y, c);
+                mpz_mod(y, y, n);
+                mpz_sub(t, x, y);
+                mpz_mul(q, q, t);
+                mpz_mod(q, q, n);
+                steps++;
+            }
+            mpz_gcd(d, q, n);
+        }
+    }
+    if (mpz_cmp(d, n) == 0) {
+        // The batch overshot; step back through it one at a time
+        do {
+            mpz_mul(ys, ys, ys);
+            mpz_add_ui(ys, ys, c);
+            mpz_mod(ys, ys, n);
+            mpz_sub(t, x, ys);
+            mpz_gcd(d, t, n);
+        } while (mpz_cmp_ui(d, 1) == 0);
+    }
+    rho_steps += steps;
+    bool found = mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n) < 0;
+    mpz_clears(x, y, ys, q, t, NULL);
+    return found;
+}
+
+static void divide_out(mpz_t x, const mpz_t p, Factorization *f) {
+    unsigned long e = 0;
+    while (mpz_divisible_p(x, p)) {
+        mpz_divexact(x, x, p);
+        e++;
+    }
+    if (e) add_factor(f, p, e);
+}
+
+// g is squarefree with every prime in [TRIAL_SMALL, TRIAL_LIMIT), so any
+// piece below TRIAL_LIMIT is one of them
+static void split_trial_part(const mpz_t g, mpz_t x, Factorization *f) {
+    if (mpz_cmp_ui(g, TRIAL_LIMIT) < 0) {
+        divide_out(x, g, f);
+        return;
+    }
+    mpz_t d, e;
+    mpz_inits(d, e, NULL);
+    for (unsigned long c = 1; !rho(d, g, c, RHO_BUDGET_NM1); c++) {}
+    mpz_divexact(e, g, d);
+    split_trial_part(d, x, f);
+    split_trial_part(e, x, f);
+    mpz_clears(d, e, NULL);
+}
+
+// Strips every prime below TRIAL_LIMIT out of each *x[i] into f[i]. The
+// numbers share the work: the product of all those primes is reduced
+// down a product tree of the x, so gcd(P mod x, x) leaves each number
+// with just the small primes that divide it.
+void trial_divide_batch(mpz_t *const *x, Factorization *const *f, size_t count) {
+    if (count == 0) return;
+    Tree t;
+    tree_build(&t, x, count);
+    mpz_t *rem = tree_remainders(&t, trial_product);
+    tree_clear(&t);
+
+    mpz_t g, p;
+    mpz_inits(g, p, NULL);
+    for (size_t i = 0; i < count; i++) {
+        mpz_gcd(g, rem[i], *x[i]);
+        for (size_t k = 0; k < small_count && mpz_cmp_ui(g, 1) > 0; k++) {
+            if (!mpz_divisible_ui_p(g, trial_primes[k])) continue;
+            mpz_divexact_ui(g, g, trial_primes[k]);
+            mpz_set_ui(p, trial_primes[k]);
+            divide_out(*x[i], p, f[i]);
+        }
+        if (mpz_cmp_ui(g, 1) > 0) split_trial_part(g, *x[i], f[i]);
+        mpz_clear(rem[i]);
+    }
+    free(rem);
+    mpz_clears(g, p, NULL);
+}
+
+// Moves the prime factors of d (a divisor of rest) out of rest into f
+static void pull_primes(Factorization *f, mpz_t rest, const mpz_t d, unsigned long budget) {
+    if (probable_prime(d)) {
+        divide_out(rest, d, f);
+        return;
+    }
+    mpz_t a, b;
+    mpz_inits(a, b, NULL);
+    for (unsigned long c = 1; c <= RHO_TRIES; c++) {
+        if (!rho(a, d, c, budget)) continue;
+        mpz_divexact(b, d, a);
+        pull_primes(f, rest, a, budget);
+        pull_primes(f, rest, b, budget);
+        break;
+    }
+    mpz_clears(a, b, NULL);
+}
+
+// Factors what trial division left, as far as the rho budget goes; an
+// unsplit composite stays in rest
+void split_cofactor(Factorization *f, mpz_t rest, unsigned long budget) {
+    mpz_t d, copy;
+    mpz_inits(d, copy, NULL);
+    while (mpz_cmp_ui(rest, 1) > 0) {
+        mpz_set(copy, rest);
+        if (probable_prime(rest)) {
+            add_factor(f, copy, 1);
+            mpz_set_ui(rest, 1);
+            break;
+        }
+        bool split = false;
+        for (unsigned long c = 1; c <= RHO_TRIES && budget && !split; c++) split = rho(d, copy, c, budget);
+        if (!split) break;
+        pull_primes(f, rest, d, budget);
+        mpz_divexact(d, copy, d);
+        if (mpz_divisible_p(rest, d)) pull_primes(f, rest, d, budget);
+        if (mpz_cmp(rest, copy) == 0) break;
+    }
+    mpz_clears(d, copy, NULL);
+}
+
+// Tonelli-Shanks; false if a is not a square mod p
+bool sqrt_mod(mpz_t r, const mpz_t a, const mpz_t p) {
+    mpz_t q, z, c, t, b, s;
+    mpz_inits(q, z, c, t, b, s, NULL);
+    bool ok = false;
+    mpz_mod(s, a, p);
+    if (mpz_sgn(s) == 0) {
+        mpz_set_ui(r, 0);
+        ok = true;
+        goto out;
+    }
+    if (mpz_jacobi(s, p) != 1) goto out;
+    mpz_sub_ui(q, p, 1);
+    unsigned long e = mpz_scan1(q, 0);
+    mpz_tdiv_q_2exp(q, q, e);
+    mpz_set_ui(z, 2);
+    while (mpz_jacobi(z, p) != -1) mpz_add_ui(z, z, 1);
+    mpz_powm(c, z, q, p);
+    mpz_powm(t, s, q, p);
+    mpz_add_ui(b, q, 1);
+    mpz_tdiv_q_2exp(b, b, 1);
+    mpz_powm(r, s, b, p);
+    unsigned long m = e;
+    while (mpz_cmp_ui(t, 1) != 0) {
+        unsigned long i = 0;
+        mpz_set(b, t);
+        while (mpz_cmp_ui(b, 1) != 0) {
+            mpz_mul(b, b, b);
+            mpz_mod(b, b, p);
+            if (++i == m) goto out;
+        }
+        mpz_set(b, c);
+        for (unsigned long j = 0; j + i + 1 < m; j++) {
+            mpz_mul(b, b, b);
+            mpz_mod(b, b, p);
+        }
+        m = i;
+        mpz_mul(c, b, b);
+        mpz_mod(c, c, p);
+        mpz_mul(t, t, c);
+        mpz_mod(t, t, p);
+        mpz_mul(r, r, b);
+        mpz_mod(r, r, p);
+    }
+    mpz_mul(b, r, r);
+    ok = mpz_congruent_p(b, s, p);
+out:
+    mpz_clears(q, z, c, t, b, s, NULL);
+    return ok;
+}
+
+// Solves u^2 + |d| v^2 = 4n (modified Cornacchia)
+bool cornacchia(mpz_t u, mpz_t v, int d, const mpz_t n) {
+    mpz_t x0, a, b, l, t;
+    mpz_inits(x0, a, b, l, t, NULL);
+    bool ok = false;
+    mpz_set_si(t, d);
+    if (!sqrt_mod(x0, t, n)) goto out;
+    if (mpz_odd_p(x0) != (d & 1)) mpz_sub(x0, n, x0);
+    mpz_mul_2exp(a, n, 1);
+    mpz_set(b, x0);
+    mpz_mul_2exp(l, n, 2);
+    mpz_sqrt(l, l);
+    while (mpz_cmp(b, l) > 0) {
+        mpz_mod(t, a, b);
+        mpz_set(a, b);
+        mpz_set(b, t);
+    }
+    mpz_mul_2exp(t, n, 2);
+    mpz_submul(t, b, b);
+    if (mpz_sgn(t) < 0 || !mpz_divisible_ui_p(t, -d)) goto out;
+    mpz_divexact_ui(t, t, -d);
+    if (!mpz_perfect_square_p(t)) goto out;
+    mpz_sqrt(v, t);
+    mpz_set(u, b);
+    ok = true;
+out:
+    mpz_clears(x0, a, b, l, t, NULL);
+    return ok;
+}
+
+// Affine points over Z/n. Each step reports whether the inverses it
+// needed existed; a missing one (or two points that only agree in x)
+// means n is composite, so the caller rejects.
+typedef struct {
+    mpz_t x, y;
+    bool inf;
+} Point;
+
+typedef struct {
+    mpz_srcptr n, a;
+    mpz_t lambda, t, u, x3;
+} Curve;
+
+static void point_init(Point *p) {
+    mpz_inits(p->x, p->y, NULL);
+    p->inf = true;
+}
+
+static void point_set(Point *r, const Point *p) {
+    mpz_set(r->x, p->x);
+    mpz_set(r->y, p->y);
+    r->inf = p->inf;
+}
+
+// r = p + q; r may be p or q
+static bool ec_add(Curve *e, Point *r, const Point *p, const Point *q) {
+    if (p->inf || q->inf) {
+        point_set(r, p->inf ? q : p);
+        return true;
+    }
+    if (mpz_congruent_p(p->x, q->x, e->n)) {
+        mpz_add(e->t, p->y, q->y);
+        if (mpz_divisible_p(e->t, e->n)) {
+            r->inf = true;
+            return true;
+        }
+        if (!mpz_congruent_p(p->y, q->y, e->n)) return false;
+        // Doubling: (3x^2 + a) / 2y
+        mpz_mul(e->u, p->x, p->x);
+        mpz_mul_ui(e->u, e->u, 3);
+        mpz_add(e->u, e->u, e->a);
+        mpz_mul_2exp(e->t, p->y, 1);
+    } else {
+        mpz_sub(e->u, q->y, p->y);
+        mpz_sub(e->t, q->x, p->x);
+    }
+    if (!mpz_invert(e->t, e->t, e->n)) return false;
+    mpz_mul(e->lambda, e->u, e->t);
+    mpz_mod(e->lambda, e->lambda, e->n);
+    mpz_mul(e->x3, e->lambda, e->lambda);
+    mpz_sub(e->x3, e->x3, p->x);
+    mpz_sub(e->x3, e->x3, q->x);
+    mpz_mod(e->x3, e->x3, e->n);
+    mpz_sub(e->t, p->x, e->x3);
+    mpz_mul(e->t, e->t, e->lambda);
+    mpz_sub(e->t, e->t, p->y);
+    mpz_mod(r->y, e->t, e->n);
+    mpz_set(r->x, e->x3);
+    r->inf = false;
+    return true;
+}
+
+static bool ec_mul(Curve *e, Point *r, const Point *p, const mpz_t k) {
+    Point acc;
+    point_init(&acc);
+    bool ok = true;
+    for (long i = (long)mpz_sizeinbase(k, 2) - 1; i >= 0 && ok; i--) {
+        ok = ec_add(e, &acc, &acc, &acc);
+        if (ok && mpz_tstbit(k, i)) ok = ec_add(e, &acc, &acc, p);
+    }
+    point_set(r, &acc);
+    mpz_clears(acc.x, acc.y, NULL);
+    return ok;
+}
+
+// (n^(1/4) + 1)^2 < (floor(n^(1/4)) + 2)^2 = bound
+static void ec_bound(mpz_t bound, const mpz_t n) {
+    mpz_root(bound, n, 4);
+    mpz_add_ui(bound, bound, 2);
+    mpz_mul(bound, bound, bound);
+}
+
+// The Goldwasser-Kilian condition, shared by the prover and --verify
+bool curve_proves(const mpz_t n, const mpz_t a, const mpz_t b, const mpz_t m, const mpz_t q,
+                  const mpz_t x, const mpz_t y) {
+    mpz_t t, k;
+    mpz_inits(t, k, NULL);
+    bool ok = false;
+    Curve e = {.n = n, .a = a};
+    mpz_inits(e.lambda, e.t, e.u, e.x3, NULL);
+    Point p, r;
+    point_init(&p);
+    point_init(&r);
+
+    // Nonsingular: gcd(4a^3 + 27b^2, n) = 1
+    mpz_powm_ui(t, a, 3, n);
+    mpz_mul_ui(t, t, 4);
+    mpz_mul(k, b, b);
+    mpz_addmul_ui(t, k, 27);
+    mpz_gcd(t, t, n);
+    if (mpz_cmp_ui(t, 1) != 0) goto out;
+    // On the curve
+    mpz_powm_ui(t, x, 3, n);
+    mpz_addmul(t, a, x);
+    mpz_add(t, t, b);
+    mpz_submul(t, y, y);
+    if (!mpz_divisible_p(t, n)) goto out;
+    ec_bound(t, n);
+    if (mpz_cmp(q, t) <= 0 || !mpz_divisible_p(m, q)) goto out;
+
+    mpz_divexact(k, m, q);
+    mpz_mod(p.x, x, n);
+    mpz_mod(p.y, y, n);
+    p.inf = false;
+    if (!ec_mul(&e, &r, &p, k) || r.inf) goto out;
+    point_set(&p, &r);
+    ok = ec_mul(&e, &r, &p, q) && r.inf;
+out:
+    mpz_clears(p.x, p.y, r.x, r.y, e.lambda, e.t, e.u, e.x3, t, k, NULL);
+    return ok;
+}
+
+// Pocklington (F^2 > n) or BLS75 theorem 5 with m = 1: F even,
+// n-1 = F(2Fs + r), n < (F + 1)(2F^2 + (r - 1)F + 1), and s = 0 or
+// r^2 - 8s not a square
+bool nm1_enough(const mpz_t n, const mpz_t f) {
+    mpz_t t, s, r;
+    mpz_inits(t, s, r, NULL);
+    bool ok = false;
+    mpz_mul(t, f, f);
+    if (mpz_cmp(t, n) > 0) {
+        ok = true;
+        goto out;
+    }
+    if (mpz_odd_p(f)) goto out;
+    mpz_sub_ui(t, n, 1);
+    mpz_divexact(t, t, f);
+    mpz_mul_2exp(s, f, 1);
+    mpz_fdiv_qr(s, r, t, s);
+    // ((2F + r - 1)F + 1)(F + 1)
+    mpz_mul_2exp(t, f, 1);
+    mpz_add(t, t, r);
+    mpz_sub_ui(t, t, 1);
+    mpz_mul(t, t, f);
+    mpz_add_ui(t, t, 1);
+    mpz_addmul(t, t, f);
+    if (mpz_cmp(n, t) >= 0) goto out;
+    if (mpz_sgn(s) == 0) {
+        ok = true;
+        goto out;
+    }
+    mpz_mul(t, r, r);
+    mpz_submul_ui(t, s, 8);
+    ok = mpz_sgn(t) < 0 || !mpz_perfect_square_p(t);
+out:
+    mpz_clears(t, s, r, NULL);
+    return ok;
+}
+
+// The Pocklington condition for a prime q of n-1 and witness a:
+// a^(n-1) = 1 and gcd(a^((n-1)/q) - 1, n) = 1
+bool witness_ok(const mpz_t n, const mpz_t q, const mpz_t a) {
+    mpz_t e, t;
+    mpz_inits(e, t, NULL);
+    mpz_sub_ui(e, n, 1);
+    mpz_divexact(e, e, q);
+    mpz_powm(e, a, e, n);
+    mpz_sub_ui(t, e, 1);
+    mpz_gcd(t, t, n);
+    bool ok = mpz_cmp_ui(t, 1) == 0;
+    mpz_powm(e, e, q, n);
+    ok = ok && mpz_cmp_ui(e, 1) == 0;
+    mpz_clears(e, t, NULL);
+    return ok;
+}
+
+// Smallest witness for q, or 0
+unsigned long find_witness(const mpz_t n, const mpz_t q) {
+    mpz_t a;
+    mpz_init(a);
+    unsigned long found = 0;
+    for (unsigned long w = 2; w < MAX_WITNESS && !found; w++) {
+        mpz_set_ui(a, w);
+        if (witness_ok(n, q, a)) found = w;
+    }
+    mpz_clear(a);
+    return found;
+}
+
+// Class polynomials for the back-off fields, from the reduced forms
+// (a, b, c) of discriminant d: the roots are j((-b + sqrt(d)) / 2a), with
+// j = E4^3 / Delta summed as q-series in plain mpf, and the product of
+// the x - j rounds to integer coefficients.
+typedef struct {
+    mpf_t re, im;
+} Complex;
+
+static void complex_init(Complex *z, mp_bitcnt_t prec) {
+    mpf_init2(z->re, prec);
+    mpf_init2(z->im, prec);
+}
+
+static void complex_clear(Complex *z) {
+    mpf_clear(z->re);
+    mpf_clear(z->im);
+}
+
+// r = a * b; r may be a or b, but not t
+static void complex_mul(Complex *r, const Complex *a, const Complex *b, Complex *t) {
+    mpf_mul(t->re, a->re, b->re);
+    mpf_mul(t->im, a->im, b->im);
+    mpf_sub(t->re, t->re, t->im);
+    mpf_mul(t->im, a->re, b->im);
+    mpf_mul(r->im, a->im, b->re);
+    mpf_add(r->im, r->im, t->im);
+    mpf_set(r->re, t->re);
+}
+
+// |x| < 2^-prec
+static bool negligible(const mpf_t x, mp_bitcnt_t prec) {
+    long exp;
+    mpf_get_d_2exp(&exp, x);
+    return mpf_sgn(x) == 0 || exp < -(long)prec;
+}
+
+// atan(1/m) = sum (-1)^k / ((2k + 1) m^(2k + 1))
+static void atan_inverse(mpf_t r, unsigned long m, mp_bitcnt_t prec) {
+    mpf_t power, term;
+    mpf_init2(power, prec);
+    mpf_init2(term, prec);
+    mpf_set_ui(power, 1);
+    mpf_div_ui(power, power, m);
+    mpf_set(r, power);
+    for (unsigned long k = 1; !negligible(power, prec); k++) {
+        mpf_div_ui(power, power, m * m);
+        mpf_div_ui(term, power, 2 * k + 1);
+        if (k % 2) {
+            mpf_sub(r, r, term);
+        } else {
+            mpf_add(r, r, term);
+        }
+    }
+    mpf_clears(power, term, NULL);
+}
+
+// Machin: pi = 16 atan(1/5) - 4 atan(1/239)
+static void compute_pi(mpf_t pi, mp_bitcnt_t prec) {
+    mpf_t t;
+    mpf_init2(t, prec);
+    atan_inverse(pi, 5, prec);
+    mpf_mul_ui(pi, pi, 16);
+    atan_inverse(t, 239, prec);
+    mpf_mul_ui(t, t, 4);
+    mpf_sub(pi, pi, t);
+    mpf_clear(t);
+}
+
+// e^-x for x >= 0: the Taylor series at x / 2^k, squared k times
+static void exp_neg(mpf_t r, const mpf_t x, mp_bitcnt_t prec) {
+    long exp;
+    mpf_get_d_2exp(&exp, x);
+    long k = exp > -8 ? exp + 8 : 0;
+    mpf_t t, term;
+    mpf_init2(t, prec);
+    mpf_init2(term, prec);
+    mpf_div_2exp(t, x, k);
+    mpf_neg(t, t);
+    mpf_set_ui(r, 1);
+    mpf_set_ui(term, 1);
+    for (unsigned long i = 1; !negligible(term, prec); i++) {
+        mpf_mul(term, term, t);
+        mpf_div_ui(term, term, i);
+        mpf_add(r, r, term);
+    }
+    for (long i = 0; i < k; i++) mpf_mul(r, r, r);
+    mpf_clears(t, term, NULL);
+}
+
+// Taylor series for both at once, |theta| <= pi
+static void cos_sin(mpf_t c, mpf_t s, const mpf_t theta, mp_bitcnt_t prec) {
+    mpf_t term;
+    mpf_init2(term, prec);
+    mpf_set_ui(c, 1);
+    mpf_set_ui(s, 0);
+    mpf_set_ui(term, 1);
+    for (unsigned long i = 1; !negligible(term, prec); i++) {
+        mpf_mul(term, term, theta);
+        mpf_div_ui(term, term, i);
+        if (i % 4 == 1) mpf_add(s, s, term);
+        if (i % 4 == 2) mpf_sub(c, c, term);
+        if (i % 4 == 3) mpf_sub(s, s, term);
+        if (i % 4 == 0) mpf_add(c, c, term);
+    }
+    mpf_clear(term);
+}
+
+// j((-b + sqrt(d)) / 2a) = E4^3 / (q prod (1 - q^n)^24), where
+// q = e^(-pi sqrt|d| / a) e^(-pi i b / a), E4 = 1 + 240 sum sigma3(n) q^n
+// and the product is Euler's pentagonal series
+static void j_invariant(Complex *j, int a, int b, int d, const mpf_t pi, mp_bitcnt_t prec) {
+    Complex q, qn, e4, eta, t, u;
+    complex_init(&q, prec);
+    complex_init(&qn, prec);
+    complex_init(&e4, prec);
+    complex_init(&eta, prec);
+    complex_init(&t, prec);
+    complex_init(&u, prec);
+    mpf_t x, r;
+    mpf_init2(x, prec);
+    mpf_init2(r, prec);
+
+    mpf_sqrt_ui(x, -d);
+    mpf_mul(x, x, pi);
+    mpf_div_ui(x, x, a);
+    exp_neg(r, x, prec);
+    mpf_mul_ui(t.re, pi, b < 0 ? -b : b);
+    mpf_div_ui(t.re, t.re, a);
+    if (b > 0) mpf_neg(t.re, t.re);
+    cos_sin(q.re, q.im, t.re, prec);
+    mpf_mul(q.re, q.re, r);
+    mpf_mul(q.im, q.im, r);
+
+    // |q|^n = e^(-nx) drops below 2^-prec
+    long terms = (long)(prec * 0.6932 / mpf_get_d(x)) + 2;
+    signed char *pentagonal = calloc(terms + 1, 1);
+    for (long k = 1; k * (3 * k - 1) / 2 <= terms; k++) {
+        pentagonal[k * (3 * k - 1) / 2] = k % 2 ? -1 : 1;
+        if (k * (3 * k + 1) / 2 <= terms) pentagonal[k * (3 * k + 1) / 2] = k % 2 ? -1 : 1;
+    }
+    mpf_set_ui(qn.re, 1);
+    mpf_set_ui(qn.im, 0);
+    mpf_set_ui(e4.re, 1);
+    mpf_set_ui(e4.im, 0);
+    mpf_set_ui(eta.re, 1);
+    mpf_set_ui(eta.im, 0);
+    for (long n = 1; n <= terms; n++) {
+        complex_mul(&qn, &qn, &q, &t);
+        unsigned long sigma3 = 0;
+        for (long k = 1; k <= n; k++) {
+            if (n % k == 0) sigma3 += (unsigned long)(k * k * k);
+        }
+        mpf_mul_ui(u.re, qn.re, 240 * sigma3);
+        mpf_mul_ui(u.im, qn.im, 240 * sigma3);
+        mpf_add(e4.re, e4.re, u.re);
+        mpf_add(e4.im, e4.im, u.im);
+        if (pentagonal[n] > 0) {
+            mpf_add(eta.re, eta.re, qn.re);
+            mpf_add(eta.im, eta.im, qn.im);
+        } else if (pentagonal[n] < 0) {
+            mpf_sub(eta.re, eta.re, qn.re);
+            mpf_sub(eta.im, eta.im, qn.im);
+        }
+    }
+    free(pentagonal);
+
+    // eta^24 = ((eta^2)^4)^3
+    complex_mul(&u, &eta, &eta, &t);
+    complex_mul(&u, &u, &u, &t);
+    complex_mul(&u, &u, &u, &t);
+    complex_mul(&eta, &u, &u, &t);
+    complex_mul(&eta, &eta, &u, &t);
+    complex_mul(&eta, &eta, &q, &t);
+    complex_mul(&u, &e4, &e4, &t);
+    complex_mul(&u, &u, &e4, &t);
+    // j = u / eta
+    mpf_mul(r, eta.re, eta.re);
+    mpf_mul(x, eta.im, eta.im);
+    mpf_add(r, r, x);
+    mpf_neg(eta.im, eta.im);
+    complex_mul(j, &u, &eta, &t);
+    mpf_div(j->re, j->re, r);
+    mpf_div(j->im, j->im, r);
+
+    mpf_clears(x, r, NULL);
+    complex_clear(&q);
+    complex_clear(&qn);
+    complex_clear(&e4);
+    complex_clear(&eta);
+    complex_clear(&t);
+    complex_clear(&u);
+}
+
+static int gcd_int(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Primitive reduced forms of discriminant d: |b| <= a <= c, b >= 0 when
+// |b| = a or a = c. Keeps the first `max` in as/bs and returns how many
+// there are, stopping at max + 1.
+static int reduced_forms(int d, int *as, int *bs, int max) {
+    int count = 0;
+    for (int a = 1; 3 * a * a <= -d; a++) {
+        for (int b = -a + 1; b <= a; b++) {
+            if ((b * b - d) % (4 * a) != 0) continue;
+            int c = (b * b - d) / (4 * a);
+            if (c < a || (b < 0 && a == c)) continue;
+            if (gcd_int(gcd_int(a, b < 0 ? -b : b), c) != 1) continue;
+            if (count < max) {
+                as[count] = a;
+                bs[count] = b;
+            }
+            if (++count > max) return count;
+        }
+    }
+    return count;
+}
+
+static void list_extra_fields(void) {
+    extra_count = 0;
+    int capacity = 0;
+    int as[EXTRA_CLASS], bs[EXTRA_CLASS];
+    for (int d = -7; d >= -EXTRA_DISC; d--) {
+        if (-d % 4 != 0 && -d % 4 != 3) continue;
+        bool listed = false;
+        for (int f = 0; f < CM_COUNT && !listed; f++) listed = CM_FIELDS[f].d == d;
+        int h = listed ? 0 : reduced_forms(d, as, bs, EXTRA_CLASS);
+        if (h == 0 || h > EXTRA_CLASS) continue;
+        if (extra_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            extra_fields = realloc(extra_fields, capacity * sizeof(ExtraField));
+        }
+        extra_fields[extra_count++] = (ExtraField){d, h, NULL};
+    }
+}
+
+static void class_polynomial(ExtraField *e) {
+    int as[EXTRA_CLASS], bs[EXTRA_CLASS];
+    reduced_forms(e->d, as, bs, EXTRA_CLASS);
+    // The coefficients stay below prod (|j| + 1), and |j| is about
+    // e^(pi sqrt|d| / a) = 2^(4.54 sqrt|d| / a)
+    int root = 1;
+    while ((root + 1) * (root + 1) <= -e->d) root++;
+    mp_bitcnt_t prec = 64 + 8 * e->degree;
+    for (int k = 0; k < e->degree; k++) prec += 5 * (root + 1) / as[k] + 1;
+
+    mpf_t pi, half;
+    mpf_init2(pi, prec);
+    mpf_init2(half, prec);
+    compute_pi(pi, prec);
+    mpf_set_d(half, 0.5);
+    Complex poly[EXTRA_CLASS + 1], j, t;
+    for (int i = 0; i <= e->degree; i++) complex_init(&poly[i], prec);
+    complex_init(&j, prec);
+    complex_init(&t, prec);
+    // prod (x - j_k), lowest coefficient first
+    mpf_set_ui(poly[0].re, 1);
+    for (int k = 0; k < e->degree; k++) {
+        j_invariant(&j, as[k], bs[k], e->d, pi, prec);
+        for (int i = k + 1; i >= 0; i--) {
+            complex_mul(&poly[i], &poly[i], &j, &t);
+            mpf_neg(poly[i].re, poly[i].re);
+            mpf_neg(poly[i].im, poly[i].im);
+            if (i > 0) {
+                mpf_add(poly[i].re, poly[i].re, poly[i - 1].re);
+                mpf_add(poly[i].im, poly[i].im, poly[i - 1].im);
+            }
+        }
+    }
+    e->h = malloc(e->degree * sizeof(mpz_t));
+    for (int i = 0; i < e->degree; i++) {
+        mpf_add(poly[i].re, poly[i].re, half);
+        mpf_floor(poly[i].re, poly[i].re);
+        mpz_init(e->h[i]);
+        mpz_set_f(e->h[i], poly[i].re);
+    }
+
+    for (int i = 0; i <= e->degree; i++) complex_clear(&poly[i]);
+    complex_clear(&j);
+    complex_clear(&t);
+    mpf_clears(pi, half, NULL);
+}
+
+static int field_d(int field) {
+    return field < CM_COUNT ? CM_FIELDS[field].d : extra_fields[field - CM_COUNT].d;
+}
+
+// Polynomials mod n, lowest coefficient first, big enough for the
+// product of two remainders mod a Hilbert class polynomial
+typedef struct {
+    int deg;            // -1 for zero
+    mpz_t c[2 * EXTRA_CLASS - 1];
+} Poly;
+
+static void poly_init(Poly *p) {
+    for (int i = 0; i < 2 * EXTRA_CLASS - 1; i++) mpz_init(p->c[i]);
+    p->deg = -1;
+}
+
+static void poly_clear(Poly *p) {
+    for (int i = 0; i < 2 * EXTRA_CLASS - 1; i++) mpz_clear(p->c[i]);
+}
+
+static void poly_set(Poly *r, const Poly *p) {
+    for (int i = 0; i <= p->deg; i++) mpz_set(r->c[i], p->c[i]);
+    r->deg = p->deg;
+}
+
+static void poly_trim(Poly *p, const mpz_t n) {
+    for (int i = 0; i <= p->deg; i++) mpz_mod(p->c[i], p->c[i], n);
+    while (p->deg >= 0 && mpz_sgn(p->c[p->deg]) == 0) p->deg--;
+}
+
+// a = a mod b; false if the leading coefficient of b is not invertible
+static bool poly_rem(Poly *a, const Poly *b, const mpz_t n) {
+    mpz_t inv, q;
+    mpz_inits(inv, q, NULL);
+    bool ok = mpz_invert(inv, b->c[b->deg], n);
+    poly_trim(a, n);
+    while (ok && a->deg >= b->deg) {
+        mpz_mul(q, a->c[a->deg], inv);
+        mpz_mod(q, q, n);
+        int shift = a->deg - b->deg;
+        for (int i = 0; i <= b->deg; i++) mpz_submul(a->c[shift + i], q, b->c[i]);
+        poly_trim(a, n);
+    }
+    mpz_clears(inv, q, NULL);
+    return ok;
+}
+
+// r = a * b mod g; r may be a or b
+static void poly_mulmod(Poly *r, const Poly *a, const Poly *b, const Poly *g, const mpz_t n) {
+    Poly t;
+    poly_init(&t);
+    t.deg = a->deg < 0 || b->deg < 0 ? -1 : a->deg + b->deg;
+    for (int i = 0; i <= a->deg; i++) {
+        for (int k = 0; k <= b->deg; k++) mpz_addmul(t.c[i + k], a->c[i], b->c[k]);
+    }
+    poly_rem(&t, g, n);
+    poly_set(r, &t);
+    poly_clear(&t);
+}
+
+// A root of the field's Hilbert class polynomial mod n. It splits into
+// linear factors when 4n = u^2 + |d|v^2 is solvable, so gcd with
+// (x + a)^((n-1)/2) - 1 for random a splits it down (Cantor-Zassenhaus).
+bool hilbert_root(mpz_t j, int field, const mpz_t n) {
+    Poly g, w, base, a, b;
+    poly_init(&g);
+    poly_init(&w);
+    poly_init(&base);
+    poly_init(&a);
+    poly_init(&b);
+    mpz_t e, t;
+    mpz_inits(e, t, NULL);
+    if (field < CM_COUNT) {
+        for (g.deg = 0; g.deg < MAX_CLASS && CM_FIELDS[field].h[g.deg]; g.deg++) {
+            mpz_set_str(g.c[g.deg], CM_FIELDS[field].h[g.deg], 10);
+        }
+    } else {
+        ExtraField *x = &extra_fields[field - CM_COUNT];
+        if (!x->h) class_polynomial(x);
+        for (g.deg = 0; g.deg < x->degree; g.deg++) mpz_set(g.c[g.deg], x->h[g.deg]);
+    }
+    mpz_set_ui(g.c[g.deg], 1);
+    poly_trim(&g, n);
+    mpz_sub_ui(e, n, 1);
+    mpz_tdiv_q_2exp(e, e, 1);
+    bool ok = true;
+    for (int tries = 0; g.deg > 2 && ok; tries++) {
+        if (tries == 32) {
+            ok = false;
+            break;
+        }
+        mpz_urandomm(base.c[0], rng, n);
+        mpz_set_ui(base.c[1], 1);
+        base.deg = 1;
+        w.deg = 0;
+        mpz_set_ui(w.c[0], 1);
+        for (long i = (long)mpz_sizeinbase(e, 2) - 1; i >= 0; i--) {
+            poly_mulmod(&w, &w, &w, &g, n);
+            if (mpz_tstbit(e, i)) poly_mulmod(&w, &w, &base, &g, n);
+        }
+        if (w.deg < 0) w.deg = 0;
+        mpz_sub_ui(w.c[0], w.c[0], 1);
+        poly_trim(&w, n);
+        // gcd(g, w)
+        poly_set(&a, &g);
+        poly_set(&b, &w);
+        while (b.deg >= 0 && ok) {
+            ok = poly_rem(&a, &b, n);
+            poly_set(&w, &a);
+            poly_set(&a, &b);
+            poly_set(&b, &w);
+        }
+        if (ok && a.deg >= 1 && a.deg < g.deg) poly_set(&g, &a);
+    }
+    if (ok && g.deg == 1) {
+        ok = mpz_invert(t, g.c[1], n);
+        mpz_mul(j, g.c[0], t);
+        mpz_neg(j, j);
+        mpz_mod(j, j, n);
+    } else if (ok && g.deg == 2) {
+        // (-c1 + sqrt(c1^2 - 4 c2 c0)) / 2c2
+        mpz_mul(t, g.c[1], g.c[1]);
+        mpz_mul(e, g.c[2], g.c[0]);
+        mpz_submul_ui(t, e, 4);
+        ok = sqrt_mod(j, t, n);
+        mpz_sub(j, j, g.c[1]);
+        mpz_mul_2exp(t, g.c[2], 1);
+        ok = ok && mpz_invert(t, t, n);
+        mpz_mul(j, j, t);
+        mpz_mod(j, j, n);
+    } else {
+        ok = false;
+    }
+    mpz_clears(e, t, NULL);
+    poly_clear(&g);
+    poly_clear(&w);
+    poly_clear(&base);
+    poly_clear(&a);
+    poly_clear(&b);
+    return ok;
+}
+
+// Looks for a curve with the field's j-invariant and order m, and a
+// point on it that proves n from q
+bool find_curve(const mpz_t n, int field, const mpz_t m, const mpz_t q, mpz_t a, mpz_t b, mpz_t x, mpz_t y,
+                int curve_tries) {
+    mpz_t j, k, c, t;
+    mpz_inits(j, k, c, t, NULL);
+    bool found = false;
+    int d = field_d(field);
+    if (d != -3 && d != -4) {
+        // k = j / (1728 - j): y^2 = x^3 + 3kc^2 x + 2kc^3 has invariant j
+        if (!hilbert_root(j, field, n)) goto out;
+        mpz_ui_sub(t, 1728, j);
+        mpz_mod(t, t, n);
+        if (!mpz_invert(t, t, n)) goto out;
+        mpz_mul(k, j, t);
+        mpz_mod(k, k, n);
+    }
+    for (int tries = 0; tries < curve_tries && !found; tries++) {
+        curves_tried++;
+        // A random twist; whether it has order m is left to the test
+        do mpz_urandomm(c, rng, n); while (mpz_sgn(c) == 0);
+        if (d == -3) {
+            mpz_set_ui(a, 0);
+            mpz_set(b, c);
+        } else if (d == -4) {
+            mpz_set(a, c);
+            mpz_set_ui(b, 0);
+        } else {
+            mpz_mul(t, c, c);
+            mpz_mul(a, t, k);
+            mpz_mul_ui(a, a, 3);
+            mpz_mod(a, a, n);
+            mpz_mul(t, t, c);
+            mpz_mul(b, t, k);
+            mpz_mul_2exp(b, b, 1);
+            mpz_mod(b, b, n);
+        }
+        for (int p = 0; p < POINT_TRIES && !found; p++) {
+            mpz_urandomm(x, rng, n);
+            mpz_powm_ui(t, x, 3, n);
+            mpz_addmul(t, a, x);
+            mpz_add(t, t, b);
+            mpz_mod(t, t, n);
+            if (mpz_sgn(t) == 0 || !sqrt_mod(y, t, n)) continue;
+            found = curve_proves(n, a, b, m, q, x, y);
+        }
+    }
+out:
+    mpz_clears(j, k, c, t, NULL);
+    return found;
+}
+
+static uint64_t hash_mpz(const mpz_t num) {
+    uint64_t h = 1469598103934665603ULL;
+    size_t n = mpz_size(num);
+    for (size_t i = 0; i < n; i++) {
+        h ^= mpz_getlimbn(num, i);
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+static size_t registry_slot(const Registry *r, const mpz_t n) {
+    size_t j = hash_mpz(n) & (r->slot_capacity - 1);
+    while (r->slots[j] && mpz_cmp(r->proofs[r->slots[j] - 1].n, n) != 0) j = (j + 1) & (r->slot_capacity - 1);
+    return j;
+}
+
+int registry_find(const Registry *r, const mpz_t n) {
+    if (!r->slot_capacity) return -1;
+    return r->slots[registry_slot(r, n)] - 1;
+}
+
+// Index of n, added if new. Adding may move the proofs array.
+int registry_add(Registry *r, const mpz_t n) {
+    int found = registry_find(r, n);
+    if (found >= 0) return found;
+    if (2 * (size_t)(r->count + 1) > r->slot_capacity) {
+        free(r->slots);
+        r->slot_capacity = r->slot_capacity ? r->slot_capacity * 2 : 1024;
+        r->slots = calloc(r->slot_capacity, sizeof(int));
+        for (int i = 0; i < r->count; i++) r->slots[registry_slot(r, r->proofs[i].n)] = i + 1;
+    }
+    if (r->count == r->capacity) {
+        r->capacity = r->capacity ? r->capacity * 2 : 256;
+        r->proofs = realloc(r->proofs, r->capacity * sizeof(Proof));
+    }
+    Proof *p = &r->proofs[r->count];
+    memset(p, 0, sizeof(*p));
+    mpz_init_set(p->n, n);
+    r->slots[registry_slot(r, n)] = r->count + 1;
+    return r->count++;
+}
+
+void registry_free(Registry *r) {
+    for (int i = 0; i < r->count; i++) {
+        mpz_clear(r->proofs[i].n);
+        free(r->proofs[i].line);
+        free(r->proofs[i].children);
+    }
+    free(r->proofs);
+    free(r->slots);
+}
+
+// The curve orders n + 1 - t of one field, each with its untouched copy
+static void add_orders(Candidates *c, const mpz_t n, int f) {
+    int d = field_d(f);
+    mpz_t u, v, t, traces[3];
+    mpz_inits(u, v, t, traces[0], traces[1], traces[2], NULL);
+    mpz_set_si(t, d);
+    if (mpz_jacobi(t, n) != 1 || !cornacchia(u, v, d, n)) goto out;
+    int trace_count = 1;
+    mpz_set(traces[0], u);
+    if (d == -4) {
+        mpz_mul_2exp(traces[trace_count++], v, 1);
+    } else if (d == -3) {
+        mpz_mul_ui(t, v, 3);
+        mpz_add(traces[1], u, t);
+        mpz_tdiv_q_2exp(traces[1], traces[1], 1);
+        mpz_sub(traces[2], u, t);
+        mpz_tdiv_q_2exp(traces[2], traces[2], 1);
+        trace_count = 3;
+    }
+    for (int i = 0; i < trace_count; i++) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            int k = c->count++;
+            mpz_init(c->m[k]);
+            mpz_add_ui(c->m[k], n, 1);
+            if (sign < 0) {
+                mpz_sub(c->m[k], c->m[k], traces[i]);
+            } else {
+                mpz_add(c->m[k], c->m[k], traces[i]);
+            }
+            mpz_init_set(c->x[k], c->m[k]);
+            init_factorization(&c->f[k]);
+            c->field[k] = f;
+            c->tried[k] = false;
+        }
+    }
+out:
+    mpz_clears(u, v, t, traces[0], traces[1], traces[2], NULL);
+}
+
+// n-1 and every curve order the CM fields give
+Candidates *candidates_begin(const mpz_t n) {
+    Candidates *c = malloc(sizeof(Candidates));
+    mpz_init(c->m[0]);
+    mpz_sub_ui(c->m[0], n, 1);
+    mpz_init_set(c->x[0], c->m[0]);
+    init_factorization(&c->f[0]);
+    c->field[0] = -1;
+    c->tried[0] = false;
+    c->count = 1;
+    for (int f = 0; f < CM_COUNT; f++) add_orders(c, n, f);
+    return c;
+}
+
+void candidates_free(Candidates *c) {
+    for (int i = 0; i < c->count; i++) {
+        mpz_clears(c->x[i], c->m[i], NULL);
+        clear_factorization(&c->f[i]);
+    }
+    free(c);
+}
+
+// Trial divides the numbers of several candidate sets in one batch
+void candidates_trial_divide(Candidates *const *cs, int count) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += cs[i]->count;
+    mpz_t **x = malloc((total + 1) * sizeof(mpz_t *));
+    Factorization **f = malloc((total + 1) * sizeof(Factorization *));
+    total = 0;
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < cs[i]->count; k++) {
+            x[total] = &cs[i]->x[k];
+            f[total++] = &cs[i]->f[k];
+        }
+    }
+    trial_divide_batch(x, f, total);
+    free(x);
+    free(f);
+}
+
+// Back-off: the orders of the extra fields, trial divided on their own
+void candidates_extend(Candidates *c, const mpz_t n) {
+    if (extra_count < 0) list_extra_fields();
+    int first = c->count;
+    for (int f = 0; f < extra_count && c->count + 2 <= MAX_ORDERS + 1; f++) add_orders(c, n, CM_COUNT + f);
+    mpz_t *x[MAX_ORDERS + 1];
+    Factorization *fs[MAX_ORDERS + 1];
+    for (int i = first; i < c->count; i++) {
+        x[i - first] = &c->x[i];
+        fs[i - first] = &c->f[i];
+    }
+    trial_divide_batch(x, fs, c->count - first);
+}
+
+int compare_orders(const void *a, const void *b) {
+    return mpz_cmp(((const Order *)a)->q, ((const Order *)b)->q);
+}
+
+// The untried orders whose cofactor (after rho with the budget) is a
+// probable prime between the bound and n, smallest q first: the fastest
+// descent
+int usable_orders(Candidates *c, const mpz_t n, Order *orders, unsigned long budget) {
+    mpz_t bound, d, e;
+    mpz_inits(bound, d, e, NULL);
+    ec_bound(bound, n);
+    int count = 0;
+    for (int i = 1; i < c->count; i++) {
+        mpz_ptr q = c->x[i];
+        if (c->tried[i]) continue;
+        // A split keeps the seed; only a seed that finds nothing is replaced
+        for (unsigned long seed = 1; seed <= RHO_TRIES && budget && mpz_cmp(q, bound) > 0 && !probable_prime(q);) {
+            if (!rho(d, q, seed, budget)) {
+                seed++;
+                continue;
+            }
+            // Keep the larger part
+            mpz_divexact(e, q, d);
+            mpz_set(q, mpz_cmp(d, e) > 0 ? d : e);
+        }
+        if (mpz_cmp(q, bound) <= 0 || mpz_cmp(q, n) >= 0 || mpz_cmp(q, c->m[i]) >= 0) continue;
+        if (!probable_prime(q)) continue;
+        c->tried[i] = true;
+        orders[count].index = i;
+        orders[count].field = c->field[i];
+        mpz_init_set(orders[count].m, c->m[i]);
+        mpz_init_set(orders[count].q, q);
+        count++;
+    }
+    qsort(orders, count, sizeof(Order), compare_orders);
+    mpz_clears(bound, d, e, NULL);
+    return count;
+}
+
+bool prove(Registry *r, int idx);
+
+static void set_proof(Registry *r, int idx, char *line, const int *children, int child_count) {
+    Proof *p = &r->proofs[idx];
+    p->line = line;
+    p->child_count = child_count;
+    p->children = malloc((child_count + 1) * sizeof(int));
+    memcpy(p->children, children, child_count * sizeof(int));
+}
+
+// N1: the factors of n-1 smallest first, proving the big ones only while
+// F still has to grow
+static bool prove_nm1(Registry *r, int idx, const mpz_t n, Candidates *c, unsigned long budget) {
+    Factorization *fac = &c->f[0];
+    split_cofactor(fac, c->x[0], budget);
+    qsort(fac->factors, fac->count, sizeof(Factor), compare_factors);
+
+    mpz_t f, t;
+    mpz_inits(f, t, NULL);
+    mpz_set_ui(f, 1);
+    for (size_t i = 0; i < fac->count; i++) {
+        mpz_pow_ui(t, fac->factors[i].prime, fac->factors[i].exponent);
+        mpz_mul(f, f, t);
+    }
+    if (!nm1_enough(n, f)) {
+        mpz_clears(f, t, NULL);
+        return false;
+    }
+
+    char *line;
+    size_t size;
+    FILE *fp = open_memstream(&line, &size);
+    gmp_fprintf(fp, "N1 %Zd", n);
+    int *children = malloc(fac->count * sizeof(int));
+    int child_count = 0;
+    bool ok = false;
+    mpz_set_ui(f, 1);
+    for (size_t i = 0; i < fac->count && !ok; i++) {
+        const Factor *q = &fac->factors[i];
+        if (!small_number(q->prime)) {
+            int child = registry_add(r, q->prime);
+            if (!prove(r, child)) continue;
+            children[child_count++] = child;
+        }
+        unsigned long a = find_witness(n, q->prime);
+        if (!a) break;
+        gmp_fprintf(fp, " %Zd:%lu", q->prime, a);
+        mpz_pow_ui(t, q->prime, q->exponent);
+        mpz_mul(f, f, t);
+        ok = nm1_enough(n, f);
+    }
+    fclose(fp);
+    if (ok) {
+        set_proof(r, idx, line, children, child_count);
+    } else {
+        free(line);
+    }
+    free(children);
+    mpz_clears(f, t, NULL);
+    return ok;
+}
+
+// EC: a curve for each usable order in turn, until its q can be proved.
+// An order whose curve was not found stays open for a later, longer search.
+static bool prove_ec(Registry *r, int idx, const mpz_t n, Candidates *c, unsigned long budget, int curve_tries) {
+    Order orders[MAX_ORDERS];
+    int count = usable_orders(c, n, orders, budget);
+    mpz_t a, b, x, y;
+    mpz_inits(a, b, x, y, NULL);
+    bool ok = false;
+    for (int i = 0; i < count && !ok; i++) {
+        const Order *o = &orders[i];
+        if (!find_curve(n, o->field, o->m, o->q, a, b, x, y, curve_tries)) {
+            c->tried[o->index] = false;
+            continue;
+        }
+        int child = -1;
+        if (!small_number(o->q)) {
+            child = registry_add(r, o->q);
+            if (!prove(r, child)) continue;
+        }
+        char *line;
+        gmp_asprintf(&line, "EC %Zd %Zd %Zd %Zd %Zd %Zd %Zd", n, a, b, o->m, o->q, x, y);
+        set_proof(r, idx, line, &child, child >= 0);
+        ok = true;
+    }
+    for (int i = 0; i < count; i++) mpz_clears(orders[i].m, orders[i].q, NULL);
+    mpz_clears(a, b, x, y, NULL);
+    return ok;
+}
+
+// Depth first with memo: a number that failed once is not retried, and
+// one on the current path counts as failed, so there are no cycles
+bool prove(Registry *r, int idx) {
+    Proof *p = &r->proofs[idx];
+    if (p->state == PROOF_DONE) return true;
+    if (p->state != PROOF_UNKNOWN) return false;
+    if (small_number(p->n)) {
+        p->state = is_prime(mpz_get_ui(p->n)) ? PROOF_DONE : PROOF_FAILED;
+        return p->state == PROOF_DONE;
+    }
+    if (!probable_prime(p->n)) {
+        p->state = PROOF_FAILED;
+        return false;
+    }
+    p->state = PROOF_RUNNING;
+    Candidates *c = p->cand;
+    p->cand = NULL;
+    if (!c) {
+        c = candidates_begin(p->n);
+        candidates_trial_divide(&c, 1);
+    }
+    mpz_t n;
+    mpz_init_set(n, p->n);
+    // What trial division alone gave first; rho only when that is not enough
+    bool ok = prove_nm1(r, idx, n, c, 0) || prove_ec(r, idx, n, c, 0, CURVE_TRIES) ||
+              prove_nm1(r, idx, n, c, RHO_BUDGET_NM1) || prove_ec(r, idx, n, c, RHO_BUDGET_ORDER, CURVE_TRIES);
+    // Back-off: the extra fields' orders, then more rho and more curves
+    // on every order still open
+    if (!ok) {
+        candidates_extend(c, n);
+        ok = prove_ec(r, idx, n, c, 0, CURVE_TRIES) || prove_ec(r, idx, n, c, RHO_BUDGET_ORDER, CURVE_TRIES);
+    }
+    for (unsigned long budget = RHO_BUDGET_ORDER * 4; !ok && budget <= RHO_BUDGET_BACKOFF; budget *= 4) {
+        ok = prove_ec(r, idx, n, c, budget, CURVE_TRIES_BACKOFF);
+    }
+    candidates_free(c);
+    mpz_clear(n);
+    r->proofs[idx].state = ok ? PROOF_DONE : PROOF_FAILED;
+    return ok;
+}
+
+// Children first, each line once
+void emit(Registry *r, int idx, FILE *out, int *lines) {
+    Proof *p = &r->proofs[idx];
+    if (p->emitted || !p->line) return;
+    p->emitted = true;
+    for (int i = 0; i < p->child_count; i++) emit(r, p->children[i], out, lines);
+    fprintf(out, "%s\n", p->line);
+    (*lines)++;
+}
+
+// The first run of digits on the line: plain numbers, program.c's text
+// and ndjson output all work
+bool read_number(mpz_t n, char *line) {
+    char *s = line;
+    while (*s && !isdigit((unsigned char)*s)) s++;
+    if (!*s) return false;
+    char *end = s;
+    while (isdigit((unsigned char)*end)) end++;
+    *end = '\0';
+    return mpz_set_str(n, s, 10) == 0;
+}
+
+static double elapsed_sec(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static bool known_prime(const Registry *proven, const mpz_t q) {
+    if (small_number(q)) return mpz_cmp_ui(q, 1) > 0 && is_prime(mpz_get_ui(q));
+    return registry_find(proven, q) >= 0;
+}
+
+static const char *verify_nm1(const Registry *proven, const mpz_t n, char **tokens, int count) {
+    const char *err = NULL;
+    mpz_t nm1, f, q, a, t;
+    mpz_inits(nm1, f, q, a, t, NULL);
+    mpz_sub_ui(nm1, n, 1);
+    mpz_set_ui(f, 1);
+    for (int i = 0; i < count && !err; i++) {
+        char *colon = strchr(tokens[i], ':');
+        if (!colon) {
+            err = "q:a の形ではありません";
+            break;
+        }
+        *colon = '\0';
+        if (mpz_set_str(q, tokens[i], 10) != 0 || mpz_set_str(a, colon + 1, 10) != 0) {
+            err = "数として読めません";
+        } else if (!known_prime(proven, q)) {
+            err = "q が証明済みの素数ではありません";
+        } else if (!mpz_divisible_p(nm1, q)) {
+            err = "q が n-1 を割り切りません";
+        } else if (mpz_divisible_p(f, q)) {
+            err = "q が重複しています";
+        } else if (!witness_ok(n, q, a)) {
+            err = "a が Pocklington の条件を満たしません";
+        } else {
+            mpz_set(t, nm1);
+            while (mpz_divisible_p(t, q)) {
+                mpz_divexact(t, t, q);
+                mpz_mul(f, f, q);
+            }
+        }
+    }
+    if (!err && !nm1_enough(n, f)) err = "F が小さすぎます";
+    mpz_clears(nm1, f, q, a, t, NULL);
+    return err;
+}
+
+static const char *verify_ec(const Registry *proven, const mpz_t n, char **tokens, int count) {
+    if (count != 6) return "EC n A B m q x y の形ではありません";
+    const char *err = NULL;
+    mpz_t v[6];
+    for (int i = 0; i < 6; i++) mpz_init(v[i]);
+    for (int i = 0; i < 6 && !err; i++) {
+        if (mpz_set_str(v[i], tokens[i], 10) != 0) err = "数として読めません";
+    }
+    if (!err && mpz_gcd_ui(NULL, n, 6) != 1) err = "n が 6 と互いに素ではありません";
+    if (!err && !known_prime(proven, v[3])) err = "q が証明済みの素数ではありません";
+    if (!err && !curve_proves(n, v[0], v[1], v[2], v[3], v[4], v[5])) err = "楕円曲線の条件を満たしません";
+    for (int i = 0; i < 6; i++) mpz_clear(v[i]);
+    return err;
+}
+
+// --verify: every line must follow from the engine and earlier lines,
+// and every number claimed on a "# n" line must end up proved
+int verify(FILE *in) {
+    Registry proven = {0};
+    mpz_t n;
+    mpz_init(n);
+    mpz_t *claims = NULL;
+    int claim_count = 0, line_no = 0, proved = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    char *tokens[MAX_TOKENS];
+    const char *err = NULL;
+    while (!err && getline(&line, &capacity, in) > 0) {
+        line_no++;
+        int count = 0;
+        for (char *tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+            if (count == MAX_TOKENS) {
+                err = "項目が多すぎます";
+                break;
+            }
+            tokens[count++] = tok;
+        }
+        if (err || count == 0) continue;
+        if (tokens[0][0] == '#') {
+            if (count == 2 && strcmp(tokens[0], "#") == 0 && mpz_set_str(n, tokens[1], 10) == 0) {
+                claims = realloc(claims, (claim_count + 1) * sizeof(mpz_t));
+                mpz_init_set(claims[claim_count++], n);
+            }
+            continue;
+        }
+        if (count < 2 || mpz_set_str(n, tokens[1], 10) != 0 || mpz_cmp_ui(n, 3) <= 0) {
+            err = "n が読めません";
+        } else if (mpz_even_p(n)) {
+            err = "n が偶数です";
+        } else if (strcmp(tokens[0], "N1") == 0) {
+            err = verify_nm1(&proven, n, tokens + 2, count - 2);
+        } else if (strcmp(tokens[0], "EC") == 0) {
+            err = verify_ec(&proven, n, tokens + 2, count - 2);
+        } else {
+            err = "N1 でも EC でもありません";
+        }
+        if (!err) {
+            int idx = registry_add(&proven, n);
+            proven.proofs[idx].state = PROOF_DONE;
+            proved++;
+        }
+    }
+    if (err) {
+        fprintf(stderr, "%d 行目: %s\n", line_no, err);
+    } else {
+        for (int i = 0; i < claim_count && !err; i++) {
+            if (known_prime(&proven, claims[i])) continue;
+            gmp_fprintf(stderr, "%Zd: 証明がありません\n", claims[i]);
+            err = "";
+        }
+    }
+    if (!err) printf("検証成功: %d 行, %d 個の素数\n", proved, claim_count);
+    for (int i = 0; i < claim_count; i++) mpz_clear(claims[i]);
+    free(claims);
+    free(line);
+    mpz_clear(n);
+    registry_free(&proven);
+    return err ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool verify_mode = false;
+    const char *path = NULL;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0) {
+            verify_mode = true;
+        } else if (path || (argv[i][0] == '-' && argv[i][1] != '\0')) {
+            usage = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (usage) {
+        fprintf(stderr, "素数証明:\n");
+        fprintf(stderr, "Usage: %s [--verify] [ファイル|-]\n", argv[0]);
+        fprintf(stderr, "証明できない素数がまれに残ります (30〜90桁のカードの素数で1万個に1個未満)\n");
+        return 1;
+    }
+    FILE *in = stdin;
+    if (path && strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if (!in) {
+            perror(path);
+            return 1;
+        }
+    }
+    if (verify_mode) return verify(in);
+
+    init_trial_primes();
+    gmp_randinit_default(rng);
+    gmp_randseed_ui(rng, 0x50524F56);
+
+    // Read everything first so the inputs share one trial division pass
+    Registry r = {0};
+    int *inputs = NULL;
+    int input_count = 0;
+    mpz_t n;
+    mpz_init(n);
+    char *line = NULL;
+    size_t capacity = 0;
+    while (getline(&line, &capacity, in) > 0) {
+        if (!read_number(n, line)) continue;
+        inputs = realloc(inputs, (input_count + 1) * sizeof(int));
+        inputs[input_count++] = registry_add(&r, n);
+    }
+    free(line);
+    if (in != stdin) fclose(in);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Candidates **batch = calloc(input_count + 1, sizeof(Candidates *));
+    int batch_count = 0;
+    for (int i = 0; i < input_count; i++) {
+        Proof *p = &r.proofs[inputs[i]];
+        if (p->cand || small_number(p->n) || !probable_prime(p->n)) continue;
+        p->cand = candidates_begin(p->n);
+        batch[batch_count++] = p->cand;
+    }
+    candidates_trial_divide(batch, batch_count);
+    free(batch);
+    fprintf(stderr, "試し割り: %d 個 (%.2f 秒)\n", batch_count, elapsed_sec(&start));
+
+    int proved = 0, lines = 0;
+    for (int i = 0; i < input_count; i++) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        bool ok = prove(&r, inputs[i]);
+        const Proof *p = &r.proofs[inputs[i]];
+        if (!ok) {
+            gmp_fprintf(stderr, "%Zd: %s\n", p->n, probable_prime(p->n) ? "証明できませんでした" : "合成数です");
+            continue;
+        }
+        int before = lines;
+        gmp_printf("# %Zd\n", p->n);
+        emit(&r, inputs[i], stdout, &lines);
+        fflush(stdout);
+        proved++;
+        gmp_fprintf(stderr, "%Zd: 証明 %d 行 (%.2f 秒)\n", p->n, lines - before, elapsed_sec(&t0));
+    }
+    fprintf(stderr, "%d / %d 個を証明, %d 行, rho %llu 回, 楕円曲線 %llu 本 (%.2f 秒)\n", proved, input_count,
+            lines, rho_steps, curves_tried, elapsed_sec(&start));
+
+    mpz_clear(n);
+    free(inputs);
+    registry_free(&r);
+    gmp_randclear(rng);
+    return proved == input_count ? 0 : 1;
+}
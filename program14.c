@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+#define MAX_NUMBER_DIGITS 19  // every 19-digit number fits in 64 bits
+#define DECK_COPIES 4         // copies of each rank A..K
+#define DECK_JOKERS 2
+#define JOKER 14              // card code and key nibble of a joker in a hand
+#define DEFAULT_SAMPLES 10000000ULL
+#define DEFAULT_TARGET 0.002  // stop once the 95% interval is this narrow
+#define MIN_SAMPLES 4096
+#define CHUNK 4096            // samples a worker draws between stop checks
+#define Z95 1.959964
+#define HAND_CACHE_BITS 20
+#define PLAY_CACHE_BITS 18
+
+// Opponent simulation: given the play on the table and every card we have
+// already seen, how likely is it that an opponent holding m unknown cards
+// can beat it (a prime from the same number of cards, larger)? Hands are
+// drawn from the rest of the deck; a joker stands for any of 0..K.
+//
+// Two caches, shared by all workers, answer repeats: whole hands by their
+// rank counts, and the card-count-sized sub-multisets a hand is made of.
+// Each entry is one atomic word (key << 2 | answer + 1), so a racing
+// write can only replace an entry, never tear it.
+
+typedef struct {
+    _Atomic uint64_t* slots;
+    uint64_t mask;
+    int shift;
+} Cache;
+
+// Xorshift (next_random's step) on RNG_LANES independent states at once.
+// The lanes never depend on each other, so the refill loop vectorizes and
+// one call yields a block of draws.
+#define RNG_LANES 8
+#define RNG_BLOCK 256
+
+typedef struct {
+    uint64_t state[RNG_LANES];
+    uint32_t block[RNG_BLOCK];
+    int used;
+} Rng;
+
+typedef struct Sim Sim;
+
+typedef struct {
+    Sim* sim;
+    Rng rng;
+    uint8_t deck[DECK_COPIES * 13 + DECK_JOKERS];
+    int hand[15];                  // counts of the current hand, [JOKER] = jokers
+    int pick[14];                  // sub-multiset being tried, [0] = jokers as 0
+    unsigned long long hands, hits, hand_hits, play_hits, plays_solved;
+    pthread_t thread;
+} Worker;
+
+struct Sim {
+    int play_cards;                // cards in the play to beat
+    unsigned long long play_value;
+    int play_digits;
+    int deck_size;
+    uint8_t deck[DECK_COPIES * 13 + DECK_JOKERS];
+    int hand_size;
+    unsigned long long max_samples;
+    double target;
+    Cache hand_cache, play_cache;
+    atomic_ullong samples, hits;   // merged after every chunk
+    atomic_bool stop;
+};
+
+static void rng_refill(Rng* g) {
+    for (int i = 0; i < RNG_BLOCK; i += RNG_LANES) {
+        for (int l = 0; l < RNG_LANES; l++) {
+            uint64_t x = g->state[l];
+            x ^= x >> 12;
+            x ^= x << 25;
+            x ^= x >> 27;
+            g->state[l] = x;
+            g->block[i + l] = (uint32_t)((x * 2685821657736338717ULL) >> 32);
+        }
+    }
+    g->used = 0;
+}
+
+static void rng_seed(Rng* g, uint64_t seed) {
+    for (int l = 0; l < RNG_LANES; l++) {
+        do g->state[l] = splitmix(&seed); while (g->state[l] == 0);
+    }
+    rng_refill(g);
+}
+
+// Uniform in [0, bound) by multiply-shift
+static inline uint32_t rng_below(Rng* g, uint32_t bound) {
+    if (g->used == RNG_BLOCK) rng_refill(g);
+    return (uint32_t)(((uint64_t)g->block[g->used++] * bound) >> 32);
+}
+
+static void cache_init(Cache* c, int bits) {
+    c->slots = calloc(1ULL << bits, sizeof(*c->slots));
+    c->mask = (1ULL << bits) - 1;
+    c->shift = 64 - bits;
+}
+
+// -1 on a miss
+static inline int cache_get(const Cache* c, uint64_t key) {
+    uint64_t word = atomic_load_explicit(&c->slots[(key * 0x9E3779B97F4A7C15ULL) >> c->shift], memory_order_relaxed);
+    if (!word || word >> 2 != key) return -1;
+    return (int)(word & 3) - 1;
+}
+
+static inline void cache_put(Cache* c, uint64_t key, bool value) {
+    atomic_store_explicit(&c->slots[(key * 0x9E3779B97F4A7C15ULL) >> c->shift], key << 2 | (value + 1),
+                          memory_order_relaxed);
+}
+
+static inline int card_digits(int r) {
+    return r >= 10 ? 2 : 1;
+}
+
+// Arrangements of the picked cards, most significant card first. All of
+// them have the same number of digits, so with as many digits as the play
+// a prefix that cannot exceed it even followed by all 9s is cut.
+static bool arrange(const Sim* s, int* counts, int left, unsigned long long value, int digits, int total) {
+    if (left == 0) return value > s->play_value && is_prime(value);
+    if (total == s->play_digits) {
+        unsigned long long scale = 1;
+        for (int d = digits; d < total; d++) scale *= 10;
+        if (value * scale + (scale - 1) <= s->play_value) return false;
+    }
+    for (int r = 13; r >= 0; r--) {
+        if (!counts[r]) continue;
+        if (r == 0 && digits == 0 && total > 1) continue;       // no leading zero
+        if (left == 1 && total > 1 && (r % 2 == 0 || r == 5)) continue;
+        counts[r]--;
+        bool found = arrange(s, counts, left - 1, value * (r >= 10 ? 100 : 10) + r, digits + card_digits(r), total);
+        counts[r]++;
+        if (found) return true;
+    }
+    return false;
+}
+
+// Can these play_cards cards (ranks 0..13) make a prime above the play?
+static bool play_beats(Worker* w, uint64_t key) {
+    Sim* s = w->sim;
+    int cached = cache_get(&s->play_cache, key);
+    if (cached >= 0) {
+        w->play_hits++;
+        return cached;
+    }
+    int counts[14];
+    int total = 0;
+    for (int r = 0; r < 14; r++) {
+        counts[r] = KEY_COUNT(key, r);
+        total += counts[r] * card_digits(r);
+    }
+    bool beats = total >= s->play_digits && total <= MAX_NUMBER_DIGITS &&
+                 arrange(s, counts, s->play_cards, 0, 0, total);
+    w->plays_solved++;
+    cache_put(&s->play_cache, key, beats);
+    return beats;
+}
+
+static uint64_t pick_key(const Worker* w) {
+    uint64_t key = 0;
+    for (int r = 0; r < 14; r++) key += w->pick[r] * KEY_ONE(r);
+    return key;
+}
+
+// The jokers left over take every multiset of values 0..13
+static bool assign_jokers(Worker* w, int rank, int left) {
+    if (left == 0) return play_beats(w, pick_key(w));
+    if (rank == 14) return false;
+    for (int c = left; c >= 0; c--) {
+        w->pick[rank] += c;
+        bool found = assign_jokers(w, rank + 1, left - c);
+        w->pick[rank] -= c;
+        if (found) return true;
+    }
+    return false;
+}
+
+// Every sub-multiset of play_cards cards: real cards first, jokers fill
+// the rest
+static bool choose(Worker* w, int rank, int left) {
+    if (rank == 14) return left <= w->hand[JOKER] && assign_jokers(w, 0, left);
+    int most = w->hand[rank] < left ? w->hand[rank] : left;
+    for (int c = most; c >= 0; c--) {
+        w->pick[rank] = c;
+        bool found = choose(w, rank + 1, left - c);
+        w->pick[rank] = 0;
+        if (found) return true;
+    }
+    return false;
+}
+
+static bool hand_beats(Worker* w, uint64_t key) {
+    Sim* s = w->sim;
+    int cached = cache_get(&s->hand_cache, key);
+    if (cached >= 0) {
+        w->hand_hits++;
+        return cached;
+    }
+    for (int r = 1; r <= JOKER; r++) w->hand[r] = KEY_COUNT(key, r);
+    bool beats = choose(w, 1, s->play_cards);
+    cache_put(&s->hand_cache, key, beats);
+    return beats;
+}
+
+// Wilson score interval half-width at 95%
+static double half_width(unsigned long long hits, unsigned long long n) {
+    if (n == 0) return 1;
+    double p = (double)hits / n, z2 = Z95 * Z95;
+    return Z95 * sqrt(p * (1 - p) / n + z2 / (4.0 * n * n)) / (1 + z2 / n);
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = arg;
+    Sim* s = w->sim;
+    memcpy(w->deck, s->deck, s->deck_size);
+    while (!atomic_load_explicit(&s->stop, memory_order_relaxed)) {
+        unsigned long long hits = 0;
+        for (int i = 0; i < CHUNK; i++) {
+            // Partial Fisher-Yates: the first hand_size cards are the hand.
+            // The deck stays a permutation, so it is never reset.
+            uint64_t key = 0;
+            for (int k = 0; k < s->hand_size; k++) {
+                int j = k + rng_below(&w->rng, s->deck_size - k);
+                uint8_t t = w->deck[j];
+                w->deck[j] = w->deck[k];
+                w->deck[k] = t;
+                key += KEY_ONE(t);
+            }
+            hits += hand_beats(w, key);
+        }
+        w->hands += CHUNK;
+        w->hits += hits;
+        unsigned long long n = atomic_fetch_add(&s->samples, CHUNK) + CHUNK;
+        unsigned long long h = atomic_fetch_add(&s->hits, hits) + hits;
+        if (n >= s->max_samples || (n >= MIN_SAMPLES && half_width(h, n) <= s->target)) {
+            atomic_store(&s->stop, true);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long max_samples = DEFAULT_SAMPLES;
+    double target = DEFAULT_TARGET;
+    uint64_t seed = time(NULL);
+    const char* seen_text = "";
+    const char* args[2] = {NULL, NULL};
+    int arg_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--seen=", 7) == 0) {
+            seen_text = argv[i] + 7;
+        } else if (strncmp(argv[i], "--samples=", 10) == 0) {
+            max_samples = strtoull(argv[i] + 10, NULL, 10);
+        } else if (strncmp(argv[i], "--target=", 9) == 0) {
+            target = atof(argv[i] + 9);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        } else if (arg_count < 2) {
+            args[arg_count++] = argv[i];
+        }
+    }
+    if (arg_count < 2) {
+        fprintf(stderr, "相手シミュレーション:\n");
+        fprintf(stderr, "Usage: %s [--seen=見えたカード] [--samples=N] [--target=E] [--threads=N] [--seed=S] 場のカード 相手の枚数\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (max_samples < CHUNK) max_samples = CHUNK;
+
+    static Sim s;
+    s.max_samples = max_samples;
+    s.target = target;
+    int left[15];
+    for (int r = 1; r <= 13; r++) left[r] = DECK_COPIES;
+    left[JOKER] = DECK_JOKERS;
+
+    int play[MAX_NUMBER_DIGITS];
+    for (const char* p = args[0]; *p; p++) {
+        if (*p == 'O') {
+            fprintf(stderr, "%s: 場のジョーカーは数字で指定してください\n", args[0]);
+            return 1;
+        }
+        int r = parse_card(*p);
+        if (r <= 0) continue;
+        if (s.play_cards == MAX_NUMBER_DIGITS) {
+            fprintf(stderr, "%s: 場のカードが多すぎます\n", args[0]);
+            return 1;
+        }
+        play[s.play_cards++] = r;
+        s.play_digits += card_digits(r);
+        left[r]--;
+    }
+    s.play_value = cards_value(play, s.play_cards);
+    if (s.play_cards == 0 || s.play_digits > MAX_NUMBER_DIGITS) {
+        fprintf(stderr, "%s: 場のカードは1枚以上、%d桁まで\n", args[0], MAX_NUMBER_DIGITS);
+        return 1;
+    }
+    for (const char* p = seen_text; *p; p++) {
+        int r = *p == 'O' ? JOKER : parse_card(*p);
+        if (r > 0) left[r]--;
+    }
+    for (int r = 1; r <= JOKER; r++) {
+        if (left[r] < 0) {
+            fprintf(stderr, "%s%s: 山札にない枚数のカードがあります\n", args[0], seen_text);
+            return 1;
+        }
+        for (int c = 0; c < left[r]; c++) s.deck[s.deck_size++] = r;
+    }
+    s.hand_size = atoi(args[1]);
+    if (s.hand_size < 1 || s.hand_size > s.deck_size) {
+        fprintf(stderr, "%s: 相手の枚数は1〜%d\n", args[1], s.deck_size);
+        return 1;
+    }
+
+    cache_init(&s.hand_cache, HAND_CACHE_BITS);
+    cache_init(&s.play_cache, PLAY_CACHE_BITS);
+    Worker* workers = calloc(threads, sizeof(Worker));
+    for (int t = 0; t < threads; t++) {
+        workers[t].sim = &s;
+        rng_seed(&workers[t].rng, seed * 0x9E3779B97F4A7C15ULL + t);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 1; t < threads; t++) pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+    worker_main(&workers[0]);
+    for (int t = 1; t < threads; t++) pthread_join(workers[t].thread, NULL);
+
+    unsigned long long n = 0, hits = 0, hand_hits = 0, play_hits = 0, solved = 0;
+    for (int t = 0; t < threads; t++) {
+        n += workers[t].hands;
+        hits += workers[t].hits;
+        hand_hits += workers[t].hand_hits;
+        play_hits += workers[t].play_hits;
+        solved += workers[t].plays_solved;
+    }
+    printf("場: %s (%d枚, %llu%s)\n", args[0], s.play_cards, s.play_value, is_prime(s.play_value) ? "" : ", 素数ではありません");
+    printf("山札の残り: %d枚 (ジョーカー %d)\n", s.deck_size, left[JOKER]);
+    printf("相手%d枚で出せる確率: %.4f ± %.4f (95%%, %llu 回)\n", s.hand_size, (double)hits / n,
+           half_width(hits, n), n);
+    fprintf(stderr, "キャッシュ: 手札 %.1f%%, 組 %llu 件を解き %llu 回再利用 (%.1f ms, %d threads)\n",
+            100.0 * hand_hits / n, solved, play_hits, elapsed_ms(&start), threads);
+
+    free(workers);
+    free((void*)s.hand_cache.slots);
+    free((void*)s.play_cache.slots);
+    return 0;
+}
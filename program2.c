@@ -4,10 +4,19 @@
 #include <gmp.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "engine_limbs.h"
 
 #define MAX_PRIME_FACTOR 10000
 #define MIN_DIGITS 19
 
+#define CACHE_CAPACITY (1 << 17)
+#define CACHE_BUCKETS (1 << 18)
+#define CACHE_MAX_LIMBS 2    // candidates top out around 30 digits
+#define CACHE_MAX_FACTORS 16
+
 typedef struct {
     mpz_t prime;
     unsigned long exponent;
@@ -16,15 +25,42 @@ typedef struct {
 typedef struct {
     Factor *factors;
     size_t count;
+    size_t capacity;
 } Factorization;
 
+// Flat factorization of one candidate; smooth == false records that the
+// candidate has a prime factor above MAX_PRIME_FACTOR
+typedef struct {
+    mp_limb_t key[CACHE_MAX_LIMBS];
+    int32_t next;           // bucket chain
+    uint8_t key_size;       // 0 marks a free entry
+    uint8_t referenced;     // CLOCK bit
+    uint8_t smooth;
+    uint8_t factor_count;
+    uint16_t primes[CACHE_MAX_FACTORS];
+    uint8_t exponents[CACHE_MAX_FACTORS];
+} CacheEntry;
+
+// Bounded memo of factorizations keyed by the candidate's limbs, evicted
+// with the CLOCK algorithm
+typedef struct {
+    CacheEntry *entries;
+    int32_t *buckets;
+    size_t hand;
+    unsigned long long hits, misses, evictions;
+} FactorCache;
+
 void init_factorization(Factorization *f) {
     f->factors = NULL;
     f->count = 0;
+    f->capacity = 0;
 }
 
 void add_factor(Factorization *f, const mpz_t prime, unsigned long exponent) {
-    f->factors = realloc(f->factors, (f->count + 1) * sizeof(Factor));
+    if (f->count == f->capacity) {
+        f->capacity = f->capacity ? f->capacity * 2 : 8;
+        f->factors = realloc(f->factors, f->capacity * sizeof(Factor));
+    }
     mpz_init(f->factors[f->count].prime);
     mpz_set(f->factors[f->count].prime, prime);
     f->factors[f->count].exponent = exponent;
@@ -68,7 +104,7 @@ bool factorize(const mpz_t n, Factorization *factors) {
     
     // Pollard's Rho algorithm for larger factors
     while (mpz_cmp_ui(remainder, 1) > 0) {
-        if (mpz_probab_prime_p(remainder, 15) > 0) {
+        if (limbs_fit(remainder) ? limbs_bpsw(remainder) : mpz_probab_prime_p(remainder, 15) > 0) {
             add_factor(factors, remainder, 1);
             break;
         }
@@ -107,6 +143,96 @@ bool factorize(const mpz_t n, Factorization *factors) {
     return true;
 }
 
+void init_cache(FactorCache *c) {
+    c->entries = calloc(CACHE_CAPACITY, sizeof(CacheEntry));
+    c->buckets = malloc(CACHE_BUCKETS * sizeof(int32_t));
+    for (size_t i = 0; i < CACHE_BUCKETS; i++) c->buckets[i] = -1;
+    c->hand = 0;
+    c->hits = c->misses = c->evictions = 0;
+}
+
+void free_cache(FactorCache *c) {
+    free(c->entries);
+    free(c->buckets);
+}
+
+static size_t cache_bucket(const mp_limb_t *limbs, size_t size) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL * (size + 1);
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ limbs[i]) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    return h & (CACHE_BUCKETS - 1);
+}
+
+// Returns the cached entry for n, or NULL on a miss
+const CacheEntry *cache_lookup(FactorCache *c, const mpz_t n) {
+    size_t size = mpz_size(n);
+    if (size > CACHE_MAX_LIMBS) {
+        c->misses++;
+        return NULL;
+    }
+    const mp_limb_t *limbs = mpz_limbs_read(n);
+    for (int32_t i = c->buckets[cache_bucket(limbs, size)]; i >= 0; i = c->entries[i].next) {
+        CacheEntry *e = &c->entries[i];
+        if (e->key_size == size && mpn_cmp(e->key, limbs, size) == 0) {
+            e->referenced = 1;
+            c->hits++;
+            return e;
+        }
+    }
+    c->misses++;
+    return NULL;
+}
+
+// Picks a victim with the CLOCK hand and unlinks it from its bucket
+static CacheEntry *cache_evict(FactorCache *c) {
+    for (;;) {
+        CacheEntry *e = &c->entries[c->hand];
+        int32_t index = (int32_t)c->hand;
+        c->hand = (c->hand + 1) % CACHE_CAPACITY;
+        if (e->key_size == 0) return e;
+        if (e->referenced) {
+            e->referenced = 0;
+            continue;
+        }
+
+        int32_t *link = &c->buckets[cache_bucket(e->key, e->key_size)];
+        while (*link != index) link = &c->entries[*link].next;
+        *link = e->next;
+        e->key_size = 0;
+        c->evictions++;
+        return e;
+    }
+}
+
+void cache_store(FactorCache *c, const mpz_t n, const Factorization *f, bool smooth) {
+    size_t size = mpz_size(n);
+    if (size == 0 || size > CACHE_MAX_LIMBS) return;
+    if (smooth && f->count > CACHE_MAX_FACTORS) return;
+
+    CacheEntry *e = cache_evict(c);
+    memcpy(e->key, mpz_limbs_read(n), size * sizeof(mp_limb_t));
+    e->key_size = size;
+    e->referenced = 0;
+    e->smooth = smooth;
+    e->factor_count = smooth ? f->count : 0;
+    for (size_t i = 0; i < e->factor_count; i++) {
+        e->primes[i] = mpz_get_ui(f->factors[i].prime);
+        e->exponents[i] = f->factors[i].exponent;
+    }
+
+    size_t b = cache_bucket(e->key, size);
+    e->next = c->buckets[b];
+    c->buckets[b] = (int32_t)(e - c->entries);
+}
+
+void print_cache_stats(const FactorCache *c) {
+    unsigned long long lookups = c->hits + c->misses;
+    fprintf(stderr, "cache: %llu lookups, %llu hits (%.1f%%), %llu evictions\n",
+            lookups, c->hits, lookups ? 100.0 * c->hits / lookups : 0.0, c->evictions);
+}
+
 void generate_number(mpz_t result) {
     const char *digits[] = {"13", "12", "11", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
     char buffer[200] = {0};
@@ -135,25 +261,60 @@ void print_factorization(const mpz_t n, const Factorization *factors) {
     printf("\n");
 }
 
+void print_cached_factorization(const mpz_t n, const CacheEntry *e) {
+    mpz_out_str(stdout, 10, n);
+    printf(" = ");
+
+    for (size_t i = 0; i < e->factor_count; i++) {
+        if (i > 0) printf("*");
+        printf("%u", e->primes[i]);
+        if (e->exponents[i] > 1) {
+            printf("^%u", e->exponents[i]);
+        }
+    }
+    printf("\n");
+}
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
 int main() {
     srand(time(NULL));
     mpz_t a;
     mpz_init(a);
+    FactorCache cache;
+    init_cache(&cache);
+
+    // Ctrl-C ends the search and reports the cache hit rate on stderr
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
     
-    while (1) {
+    while (!stop_requested) {
         generate_number(a);
         
         // Check minimum digit count
         if (mpz_sizeinbase(a, 10) < MIN_DIGITS) {
             continue;
         }
+
+        const CacheEntry *cached = cache_lookup(&cache, a);
+        if (cached) {
+            if (cached->smooth) {
+                print_cached_factorization(a, cached);
+            }
+            continue;
+        }
         
         Factorization factors;
         init_factorization(&factors);
         
-        if (factorize(a, &factors)) {
+        bool valid = factorize(a, &factors);
+        if (valid) {
             // Check if all factors are below threshold
-            bool valid = true;
             for (size_t i = 0; i < factors.count; i++) {
                 if (mpz_cmp_ui(factors.factors[i].prime, MAX_PRIME_FACTOR) > 0) {
                     valid = false;
@@ -165,10 +326,13 @@ int main() {
                 print_factorization(a, &factors);
             }
         }
+        cache_store(&cache, a, &factors, valid);
         
         clear_factorization(&factors);
     }
     
+    print_cache_stats(&cache);
+    free_cache(&cache);
     mpz_clear(a);
     return 0;
 }
@@ -5,67 +5,35 @@
 #include <stdbool.h>
 #include <ctype.h>
 
+#include "engine.h"
+#include "output.h"
+
 #define MAX_LEN 100
 
-unsigned long long mulmod(unsigned long long a, unsigned long long b, unsigned long long mod) {
-    unsigned long long res = 0;
-    a %= mod;
-    while (b > 0) {
-        if (b % 2 == 1) {
-            res = (res + a) % mod;
-        }
-        a = (a * 2) % mod;
-        b /= 2;
+// text: [n1,n2]   ndjson: {"n":[n1,n2]}   binary: two i32
+void out_pair(Output* out, int n1, int n2) {
+    if (out->format == FORMAT_BINARY) {
+        out_le(out, (unsigned)n1, 4);
+        out_le(out, (unsigned)n2, 4);
+        return;
     }
-    return res % mod;
+    out_str(out, out->format == FORMAT_NDJSON ? "{\"n\":[" : "[");
+    out_int(out, n1);
+    out_bytes(out, ",", 1);
+    out_int(out, n2);
+    out_str(out, out->format == FORMAT_NDJSON ? "]}\n" : "]\n");
 }
 
-// Function to compute (base^exp) % mod efficiently
-unsigned long long powmod(unsigned long long base, unsigned long long exp, unsigned long long mod) {
-    unsigned long long res = 1;
-    base %= mod;
-    while (exp > 0) {
-        if (exp % 2 == 1) {
-            res = mulmod(res, base, mod);
-        }
-        base = mulmod(base, base, mod);
-        exp /= 2;
-    }
-    return res;
-}
+typedef struct {
+    int n1, n2;
+} Pair;
 
-// Miller-Rabin primality test
-bool is_prime(unsigned long long n, int k) {
-    if (n <= 1) return false;
-    if (n <= 3) return true;
-    if (n % 2 == 0) return false;
-    
-    // Write n-1 as d*2^s
-    unsigned long long d = n - 1;
-    int s = 0;
-    while (d % 2 == 0) {
-        d /= 2;
-        s++;
-    }
-    
-    // Test for k witnesses
-    for (int i = 0; i < k; i++) {
-        // Choose a random number between [2, n-2]
-        unsigned long long a = 2 + rand() % (n - 3);
-        unsigned long long x = powmod(a, d, n);
-        
-        if (x == 1 || x == n - 1) continue;
-        
-        int j;
-        for (j = 0; j < s - 1; j++) {
-            x = mulmod(x, x, n);
-            if (x == n - 1) break;
-        }
-        
-        if (j == s - 1) return false; // composite
-    }
-    
-    return true; // probably prime
+int compare_pairs(const void* a, const void* b) {
+    const Pair* pa = (const Pair*)a;
+    const Pair* pb = (const Pair*)b;
+    if (pa->n1 != pb->n1) return pa->n1 < pb->n1 ? -1 : 1;
+    if (pa->n2 != pb->n2) return pa->n2 < pb->n2 ? -1 : 1;
+    return 0;
 }
 
 void shuffle(char *s, int len) {
@@ -100,7 +68,7 @@ void proceed(char c, char *buf, int *idx) {
     else buf[(*idx)++] = c;
 }
 
-void generate(char *text, int split, char *p1, char *p2) {
+void split_play(char *text, int split, char *p1, char *p2) {
     int len = strlen(text);
     split = (split <= 0 || split >= len) ? rand()%(len-1)+1 : split;
     shuffle(text, len);
@@ -121,21 +89,45 @@ void generate(char *text, int split, char *p1, char *p2) {
 }
 
 int main(int argc, char *argv[]) {
+    static Output out = {.format = FORMAT_TEXT, .echo = true};
+    argc = take_output_flags(&out, argc, argv);
+
     if (argc < 3) {
       fprintf(stderr, "2発出し:\n");
-      printf("Usage: %s times text [split]\n", argv[0]);
+      fprintf(stderr, "Usage: %s times text [split] [--format=text|ndjson|binary] [--no-echo]\n", argv[0]);
       return 1;
     }
     
     srand(time(0));
     int times = atoi(argv[1]), split = argc>3 ? atoi(argv[3]) : 0;
+    Pair* pairs = NULL;
+    size_t pairs_size = 0, pairs_capacity = 0;
     
     while (times--) {
         char p1[MAX_LEN], p2[MAX_LEN];
-        generate(argv[2], split, p1, p2);
+        split_play(argv[2], split, p1, p2);
         
         int n1 = atoi(p1), n2 = atoi(p2);
-        if (is_prime(n1,40) && is_prime(n2,40)) { printf("[%d,%d]\n", n1, n2); } else { /*puts("NULL")*/};
+        if (is_prime(n1) && is_prime(n2)) {
+            if (out.echo) {
+                out_pair(&out, n1, n2);
+            } else {
+                if (pairs_size == pairs_capacity) {
+                    pairs_capacity = pairs_capacity ? pairs_capacity * 2 : 64;
+                    pairs = realloc(pairs, pairs_capacity * sizeof(Pair));
+                }
+                pairs[pairs_size++] = (Pair){n1, n2};
+            }
+        } else { /*puts("NULL")*/};
+    }
+
+    // --no-echo: each distinct pair once, sorted
+    if (pairs_size > 0) qsort(pairs, pairs_size, sizeof(Pair), compare_pairs);
+    for (size_t i = 0; i < pairs_size; i++) {
+        if (i > 0 && compare_pairs(&pairs[i], &pairs[i - 1]) == 0) continue;
+        out_pair(&out, pairs[i].n1, pairs[i].n2);
     }
+    out_flush(&out);
+    free(pairs);
     return 0;
 }
@@ -3,217 +3,933 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "output.h"
+#include "deadline.h"
+
+// Card sequences live in one arena, packed two ranks (0-13) per byte
+typedef struct {
+    uint8_t* bytes;
+    size_t size;      // nibbles used
+    size_t capacity;  // nibbles allocated
+} CardArena;
 
 typedef struct {
-    int* elements;
-    int elements_size;
     unsigned long long concatenated_num;
+    uint64_t key;     // 14 x 4-bit rank counts, the canonical hand
+    uint32_t offset;  // first nibble in the arena
+    uint32_t elements_size;
 } PrimeEntry;
 
-int scaledrand(int x) {
-    if (x == 0) return 0;
-    int a = rand() % (x + 1);
-    int b = rand() % x;
-    return a > b ? a : b;
-}
+// The hand is parsed once; jokers are redrawn on every generate_entry() call
+typedef struct {
+    int counts[14];
+    int jokers;
+    int size;
+} HandTemplate;
 
-void generate(const char* text, int** elements_ptr, int* elements_size) {
-    int counts[14] = {0};
+void parse_template(const char* text, HandTemplate* hand) {
+    memset(hand, 0, sizeof(*hand));
     for (const char* p = text; *p != '\0'; p++) {
-        char c = *p;
-        int value;
-        switch (c) {
-            case 'A': value = 1; break;
-            case '2': value = 2; break;
-            case '3': value = 3; break;
-            case '4': value = 4; break;
-            case '5': value = 5; break;
-            case '6': value = 6; break;
-            case '7': value = 7; break;
-            case '8': value = 8; break;
-            case '9': value = 9; break;
-            case 'T': value = 10; break;
-            case 'J': value = 11; break;
-            case 'Q': value = 12; break;
-            case 'K': value = 13; break;
-            case 'O': value = rand() % 14; break;
-            default: value = -1;
-        }
-        if (value >= 0 && value <= 13) {
-            counts[value]++;
-        }
-    }
-
-    int* elements = NULL;
-    size_t capacity = 0;
-    size_t size = 0;
+        int value = *p == 'O' ? 14 : parse_card(*p);
+        if (value == 14) {
+            hand->jokers++;
+            hand->size++;
+        } else if (value >= 0) {
+            hand->counts[value]++;
+            hand->size++;
+        }
+    }
+}
+
+void arena_push(CardArena* arena, int rank) {
+    if (arena->size == arena->capacity) {
+        arena->capacity = arena->capacity ? arena->capacity * 2 : 1024;
+        arena->bytes = realloc(arena->bytes, arena->capacity / 2);
+    }
+    uint8_t* byte = &arena->bytes[arena->size / 2];
+    if (arena->size % 2 == 0) {
+        *byte = rank;
+    } else {
+        *byte |= rank << 4;
+    }
+    arena->size++;
+}
+
+static inline int arena_get(const CardArena* arena, size_t i) {
+    return (arena->bytes[i / 2] >> (4 * (i % 2))) & 15;
+}
+
+// Appends a sequence from another arena; returns its new offset
+uint32_t arena_copy(CardArena* dst, const CardArena* src, uint32_t offset, uint32_t size) {
+    uint32_t start = dst->size;
+    for (uint32_t i = 0; i < size; i++) arena_push(dst, arena_get(src, offset + i));
+    return start;
+}
+
+// Draws a random sub-multiset in random order straight into the arena and
+// fills in its value (saturating like strtoull) and hand key
+void generate_entry(const HandTemplate* hand, CardArena* arena, PrimeEntry* entry, uint64_t* rng) {
+    int counts[14];
+    memcpy(counts, hand->counts, sizeof(counts));
+    for (int j = 0; j < hand->jokers; j++) counts[next_random(rng) % 14]++;
+
+    uint8_t elements[hand->size + 1];
+    int size = 0;
     for (int i = 0; i < 14; i++) {
         if (counts[i] == 0) continue;
-        int s = scaledrand(counts[i]);
+        int s = scaledrand_r(counts[i], rng);
         for (int j = 0; j < s; j++) {
-            if (size >= capacity) {
-                capacity = (capacity == 0) ? 1 : capacity * 2;
-                elements = realloc(elements, capacity * sizeof(int));
-            }
             elements[size++] = i;
         }
     }
 
     if (size > 0) {
-        for (size_t i = 0; i < size - 1; i++) {
-            size_t j = i + rand() % (size - i);
-            int temp = elements[j];
+        for (int i = 0; i < size - 1; i++) {
+            int j = i + next_random(rng) % (size - i);
+            uint8_t temp = elements[j];
             elements[j] = elements[i];
             elements[i] = temp;
         }
     }
 
-    *elements_ptr = elements;
-    *elements_size = size;
+    unsigned long long num = 0;
+    uint64_t key = 0;
+    bool overflow = false;
+    entry->offset = arena->size;
+    entry->elements_size = size;
+    for (int i = 0; i < size; i++) {
+        int r = elements[i];
+        arena_push(arena, r);
+        key += 1ULL << (4 * r);
+        overflow |= __builtin_mul_overflow(num, r >= 10 ? 100 : 10, &num);
+        overflow |= __builtin_add_overflow(num, r, &num);
+    }
+    entry->concatenated_num = overflow ? ULLONG_MAX : num;
+    entry->key = key;
 }
 
-char* concatenate_numbers(int* array, int size) {
-    int total_length = 0;
-    for (int i = 0; i < size; i++) {
-        total_length += snprintf(NULL, 0, "%d", array[i]);
+int compare_prime_entries(const void* a, const void* b) {
+    const PrimeEntry* pa = (const PrimeEntry*)a;
+    const PrimeEntry* pb = (const PrimeEntry*)b;
+    if (pa->concatenated_num < pb->concatenated_num) return -1;
+    if (pa->concatenated_num > pb->concatenated_num) return 1;
+    if (pa->key < pb->key) return -1;
+    if (pa->key > pb->key) return 1;
+    return 0;
+}
+
+// "prefix cards -> n" in text, a record otherwise
+void out_entry(Output* out, const char* prefix, const CardArena* arena, const PrimeEntry* entry) {
+    int cards[entry->elements_size + 1];
+    for (uint32_t i = 0; i < entry->elements_size; i++) cards[i] = arena_get(arena, entry->offset + i);
+    if (out->format == FORMAT_TEXT) out_str(out, prefix);
+    out_hit(out, cards, entry->elements_size, entry->concatenated_num);
+}
+
+// Result sink. By default every hit stays in memory until the end;
+// --top=K keeps only the K largest in a min-heap, and --run-size=N sorts,
+// dedups and spills every N hits to a temporary file, merging the runs at
+// the end. Either way memory stays bounded however long the search runs.
+#define RUN_FAN_IN 16        // runs merged into one at a time
+
+typedef struct {
+    FILE* fp;
+    PrimeEntry head;     // current record; offset unused
+    int* cards;
+    int cards_capacity;
+} RunReader;
+
+// A spilled run and how many merges went into it. Every RUN_FAN_IN runs of
+// one level are merged into one run of the next, so open files grow with
+// the log of the hits, not with the hits.
+typedef struct {
+    FILE* fp;
+    int level;
+} SpillRun;
+
+// What makes two hits the same: the value and the cards behind it
+typedef struct {
+    unsigned long long num;
+    uint64_t key;        // 0: empty slot (every hit has cards)
+} HitKey;
+
+typedef struct {
+    int top;             // 0: keep every hit
+    size_t run_size;     // 0: never spill
+    PrimeEntry* entries; // hits, or the top-K heap (smallest at entries[0])
+    size_t size, capacity;
+    CardArena cards;
+    HitKey* seen;        // the heap's hits, open addressing with linear probing
+    size_t seen_mask;
+    SpillRun* runs;
+    int run_count;
+    unsigned long long total; // hits added
+} ResultSink;
+
+static void sink_append(ResultSink* sink, const CardArena* src, PrimeEntry entry) {
+    if (sink->size == sink->capacity) {
+        sink->capacity = sink->capacity ? sink->capacity * 2 : 256;
+        sink->entries = realloc(sink->entries, sink->capacity * sizeof(PrimeEntry));
     }
-    char* result = malloc(total_length + 1);
-    result[0] = '\0';
-    for (int i = 0; i < size; i++) {
-        char num_str[20];
-        snprintf(num_str, sizeof(num_str), "%d", array[i]);
-        strcat(result, num_str);
-    }
-    return result;
-}
-
-unsigned long long mulmod(unsigned long long a, unsigned long long b, unsigned long long mod) {
-    unsigned long long res = 0;
-    a %= mod;
-    while (b > 0) {
-        if (b % 2 == 1) {
-            res = (res + a) % mod;
-        }
-        a = (a * 2) % mod;
-        b /= 2;
-    }
-    return res % mod;
-}
-
-unsigned long long powmod(unsigned long long base, unsigned long long exp, unsigned long long mod) {
-    unsigned long long res = 1;
-    base %= mod;
-    while (exp > 0) {
-        if (exp % 2 == 1) {
-            res = mulmod(res, base, mod);
-        }
-        base = mulmod(base, base, mod);
-        exp /= 2;
-    }
-    return res;
-}
-
-bool is_prime(unsigned long long n, int k) {
-    if (n <= 1) return false;
-    if (n <= 3) return true;
-    if (n % 2 == 0) return false;
-    
-    unsigned long long d = n - 1;
-    int s = 0;
-    while (d % 2 == 0) {
-        d /= 2;
-        s++;
-    }
-    
-    for (int i = 0; i < k; i++) {
-        unsigned long long a = 2 + rand() % (n - 3);
-        unsigned long long x = powmod(a, d, n);
-        
-        if (x == 1 || x == n - 1) continue;
-        
-        int j;
-        for (j = 0; j < s - 1; j++) {
-            x = mulmod(x, x, n);
-            if (x == n - 1) break;
-        }
-        
-        if (j == s - 1) return false;
-    }
-    
+    entry.offset = arena_copy(&sink->cards, src, entry.offset, entry.elements_size);
+    sink->entries[sink->size++] = entry;
+}
+
+static size_t seen_home(const ResultSink* sink, HitKey k) {
+    uint64_t h = k.num ^ k.key * 0x9E3779B97F4A7C15ULL;
+    return splitmix(&h) & sink->seen_mask;
+}
+
+// The slot holding k, or the empty slot where it would go
+static size_t seen_slot(const ResultSink* sink, HitKey k) {
+    size_t i = seen_home(sink, k);
+    while (sink->seen[i].key != 0 && (sink->seen[i].num != k.num || sink->seen[i].key != k.key)) {
+        i = (i + 1) & sink->seen_mask;
+    }
+    return i;
+}
+
+// Deleting from a probe chain: later entries that hashed at or before the
+// hole move back into it, so lookups never stop short
+static void seen_remove(ResultSink* sink, HitKey k) {
+    size_t i = seen_slot(sink, k);
+    if (sink->seen[i].key == 0) return;
+    for (size_t j = i;;) {
+        sink->seen[i].key = 0;
+        for (;;) {
+            j = (j + 1) & sink->seen_mask;
+            if (sink->seen[j].key == 0) return;
+            size_t home = seen_home(sink, sink->seen[j]);
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue;
+            sink->seen[i] = sink->seen[j];
+            i = j;
+            break;
+        }
+    }
+}
+
+static void heap_sift_down(PrimeEntry* heap, size_t size, size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < size && compare_prime_entries(&heap[l], &heap[m]) < 0) m = l;
+        if (r < size && compare_prime_entries(&heap[r], &heap[m]) < 0) m = r;
+        if (m == i) return;
+        PrimeEntry t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+static void heap_sift_up(PrimeEntry* heap, size_t i) {
+    while (i > 0 && compare_prime_entries(&heap[i], &heap[(i - 1) / 2]) < 0) {
+        PrimeEntry t = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = t;
+        i = (i - 1) / 2;
+    }
+}
+
+// Evicted heap entries leave dead cards behind; rebuild the arena once
+// they outweigh the live ones
+static void sink_compact(ResultSink* sink) {
+    size_t live = 0;
+    for (size_t i = 0; i < sink->size; i++) live += sink->entries[i].elements_size;
+    if (sink->cards.size < 2 * live + 1024) return;
+    CardArena fresh = {0};
+    for (size_t i = 0; i < sink->size; i++) {
+        PrimeEntry* e = &sink->entries[i];
+        e->offset = arena_copy(&fresh, &sink->cards, e->offset, e->elements_size);
+    }
+    free(sink->cards.bytes);
+    sink->cards = fresh;
+}
+
+static FILE* run_create(void) {
+    FILE* fp = tmpfile();
+    if (!fp) {
+        perror("tmpfile");
+        exit(1);
+    }
+    return fp;
+}
+
+// Run record: u64 num, u64 key, u32 card count, one byte per card
+static void run_write(FILE* fp, const PrimeEntry* e, const int* cards) {
+    uint8_t bytes[e->elements_size + 1];
+    for (uint32_t i = 0; i < e->elements_size; i++) bytes[i] = cards[i];
+    fwrite(&e->concatenated_num, sizeof(e->concatenated_num), 1, fp);
+    fwrite(&e->key, sizeof(e->key), 1, fp);
+    fwrite(&e->elements_size, sizeof(e->elements_size), 1, fp);
+    fwrite(bytes, 1, e->elements_size, fp);
+}
+
+static bool run_next(RunReader* r) {
+    PrimeEntry* h = &r->head;
+    if (fread(&h->concatenated_num, sizeof(h->concatenated_num), 1, r->fp) != 1 ||
+        fread(&h->key, sizeof(h->key), 1, r->fp) != 1 ||
+        fread(&h->elements_size, sizeof(h->elements_size), 1, r->fp) != 1) return false;
+    if ((int)h->elements_size > r->cards_capacity) {
+        r->cards_capacity = h->elements_size;
+        r->cards = realloc(r->cards, r->cards_capacity * sizeof(int));
+    }
+    for (uint32_t i = 0; i < h->elements_size; i++) r->cards[i] = fgetc(r->fp);
     return true;
 }
 
-void print_comma_separated(int* array, int size) {
-    for (int i = 0; i < size; i++) {
-        printf("%d", array[i]);
-        if (i < size - 1) {
-            printf(",");
+static bool reader_less(const RunReader* readers, int a, int b) {
+    return compare_prime_entries(&readers[a].head, &readers[b].head) < 0;
+}
+
+// k-way merge of `count` runs over a min-heap of run indices keyed on each
+// run's head. The distinct entries go in ascending order to `dest` as a new
+// run, or to `out` when dest is NULL. Closes the input runs.
+static void merge_runs(const SpillRun* runs, int count, FILE* dest, Output* out) {
+    RunReader* readers = calloc(count, sizeof(RunReader));
+    int* heap = malloc(count * sizeof(int));
+    int heap_size = 0;
+    for (int i = 0; i < count; i++) {
+        readers[i].fp = runs[i].fp;
+        if (!run_next(&readers[i])) continue;
+        int j = heap_size++;
+        heap[j] = i;
+        while (j > 0 && reader_less(readers, heap[j], heap[(j - 1) / 2])) {
+            int t = heap[j];
+            heap[j] = heap[(j - 1) / 2];
+            heap[(j - 1) / 2] = t;
+            j = (j - 1) / 2;
+        }
+    }
+
+    PrimeEntry last = {0};
+    bool have_last = false;
+    while (heap_size > 0) {
+        RunReader* r = &readers[heap[0]];
+        if (!have_last || compare_prime_entries(&r->head, &last) != 0) {
+            if (dest) {
+                run_write(dest, &r->head, r->cards);
+            } else {
+                out_hit(out, r->cards, r->head.elements_size, r->head.concatenated_num);
+            }
+            last = r->head;
+            have_last = true;
+        }
+        if (!run_next(r)) heap[0] = heap[--heap_size];
+        for (int i = 0;;) {
+            int l = 2 * i + 1, rr = l + 1, m = i;
+            if (l < heap_size && reader_less(readers, heap[l], heap[m])) m = l;
+            if (rr < heap_size && reader_less(readers, heap[rr], heap[m])) m = rr;
+            if (m == i) break;
+            int t = heap[i];
+            heap[i] = heap[m];
+            heap[m] = t;
+            i = m;
         }
     }
+
+    for (int i = 0; i < count; i++) {
+        fclose(readers[i].fp);
+        free(readers[i].cards);
+    }
+    free(readers);
+    free(heap);
 }
 
-int compare_prime_entries(const void* a, const void* b) {
-    const PrimeEntry* pa = (const PrimeEntry*)a;
-    const PrimeEntry* pb = (const PrimeEntry*)b;
-    if (pa->concatenated_num < pb->concatenated_num) return -1;
-    if (pa->concatenated_num > pb->concatenated_num) return 1;
+// Sorts and dedups the pending hits into a new run
+static void sink_spill(ResultSink* sink) {
+    qsort(sink->entries, sink->size, sizeof(PrimeEntry), compare_prime_entries);
+    FILE* fp = run_create();
+    for (size_t i = 0; i < sink->size; i++) {
+        const PrimeEntry* e = &sink->entries[i];
+        if (i > 0 && compare_prime_entries(e, &sink->entries[i - 1]) == 0) continue;
+        int cards[e->elements_size + 1];
+        for (uint32_t j = 0; j < e->elements_size; j++) cards[j] = arena_get(&sink->cards, e->offset + j);
+        run_write(fp, e, cards);
+    }
+    rewind(fp);
+    sink->runs = realloc(sink->runs, (sink->run_count + 1) * sizeof(SpillRun));
+    sink->runs[sink->run_count++] = (SpillRun){fp, 0};
+    sink->size = 0;
+    sink->cards.size = 0;
+
+    // Levels never rise along runs[], so the last RUN_FAN_IN share a level
+    // exactly when the first and last of them do
+    while (sink->run_count >= RUN_FAN_IN) {
+        SpillRun* tail = &sink->runs[sink->run_count - RUN_FAN_IN];
+        if (tail->level != sink->runs[sink->run_count - 1].level) break;
+        FILE* merged = run_create();
+        merge_runs(tail, RUN_FAN_IN, merged, NULL);
+        rewind(merged);
+        *tail = (SpillRun){merged, tail->level + 1};
+        sink->run_count -= RUN_FAN_IN - 1;
+    }
+}
+
+void sink_add(ResultSink* sink, const CardArena* src, const PrimeEntry* entry) {
+    sink->total++;
+    if (sink->top == 0) {
+        sink_append(sink, src, *entry);
+        if (sink->run_size && sink->size == sink->run_size) sink_spill(sink);
+        return;
+    }
+    if (sink->size == (size_t)sink->top && compare_prime_entries(entry, &sink->entries[0]) <= 0) return;
+    if (!sink->seen) {
+        size_t slots = 16;
+        while (slots < 2 * (size_t)sink->top) slots *= 2;
+        sink->seen = calloc(slots, sizeof(HitKey));
+        sink->seen_mask = slots - 1;
+    }
+    // The same number from the same cards in another order
+    HitKey k = {entry->concatenated_num, entry->key};
+    size_t slot = seen_slot(sink, k);
+    if (sink->seen[slot].key != 0) return;
+    if (sink->size < (size_t)sink->top) {
+        sink->seen[slot] = k;
+        sink_append(sink, src, *entry);
+        heap_sift_up(sink->entries, sink->size - 1);
+        return;
+    }
+    seen_remove(sink, (HitKey){sink->entries[0].concatenated_num, sink->entries[0].key});
+    sink->seen[seen_slot(sink, k)] = k;
+    PrimeEntry e = *entry;
+    e.offset = arena_copy(&sink->cards, src, e.offset, e.elements_size);
+    sink->entries[0] = e;
+    heap_sift_down(sink->entries, sink->size, 0);
+    sink_compact(sink);
+}
+
+// Writes the sink's distinct entries in ascending order
+void sink_write(ResultSink* sink, Output* out) {
+    if (sink->run_count == 0) {
+        qsort(sink->entries, sink->size, sizeof(PrimeEntry), compare_prime_entries);
+        for (size_t i = 0; i < sink->size; i++) {
+            if (i > 0 && compare_prime_entries(&sink->entries[i], &sink->entries[i - 1]) == 0) continue;
+            out_entry(out, "", &sink->cards, &sink->entries[i]);
+        }
+        return;
+    }
+
+    if (sink->size > 0) sink_spill(sink);
+    merge_runs(sink->runs, sink->run_count, NULL, out);
+    sink->run_count = 0;
+}
+
+void sink_free(ResultSink* sink) {
+    for (int i = 0; i < sink->run_count; i++) fclose(sink->runs[i].fp);
+    free(sink->runs);
+    free(sink->seen);
+    free(sink->entries);
+    free(sink->cards.bytes);
+}
+
+// Statistics mode (--stats=EPS): samples until the 95% Wilson interval of
+// the hit rate is within +-EPS for every card count and digit length that
+// gets at least STATS_MIN_SHARE of the samples. Rarer buckets are still
+// reported, they just do not hold up the stop. n caps the samples (0: no cap).
+#define STATS_CHUNK 4096       // samples a thread draws between merges
+#define STATS_MIN_SHARE 0.01
+#define STATS_Z 1.96
+#define STATS_MAX_CARDS 32
+
+typedef struct {
+    unsigned long long trials, hits;
+} Tally;
+
+typedef struct {
+    Tally by_cards[STATS_MAX_CARDS + 1];
+    Tally by_digits[2 * STATS_MAX_CARDS + 1];
+    unsigned long long samples;
+} StatsTable;
+
+typedef struct {
+    const HandTemplate* hand;
+    double eps;
+    unsigned long long budget;
+    pthread_mutex_t lock;
+    StatsTable table;
+    atomic_bool done;
+    bool converged;
+} StatsRun;
+
+typedef struct {
+    StatsRun* run;
+    pthread_t thread;
+    uint64_t rng;
+} StatsWorker;
+
+static double wilson_half_width(const Tally* t, double* center) {
+    double n = t->trials, p = t->hits / n, z2 = STATS_Z * STATS_Z;
+    double denom = 1 + z2 / n;
+    *center = (p + z2 / (2 * n)) / denom;
+    return STATS_Z * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / denom;
+}
+
+static bool tallies_converged(const Tally* tallies, int count, unsigned long long samples, double eps) {
+    double center;
+    for (int i = 0; i < count; i++) {
+        if (tallies[i].trials == 0 || tallies[i].trials < STATS_MIN_SHARE * samples) continue;
+        if (wilson_half_width(&tallies[i], &center) > eps) return false;
+    }
+    return true;
+}
+
+static void merge_tallies(Tally* dst, const Tally* src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i].trials += src[i].trials;
+        dst[i].hits += src[i].hits;
+    }
+}
+
+void* stats_worker(void* arg) {
+    StatsWorker* sw = arg;
+    StatsRun* run = sw->run;
+    CardArena arena = {0};
+    PrimeEntry batch[PRIME_BATCH];
+    unsigned long long nums[PRIME_BATCH];
+    bool prime[PRIME_BATCH];
+    StatsTable local;
+
+    while (!atomic_load(&run->done)) {
+        memset(&local, 0, sizeof(local));
+        for (int c = 0; c < STATS_CHUNK; c += PRIME_BATCH) {
+            arena.size = 0;
+            for (int b = 0; b < PRIME_BATCH; b++) {
+                generate_entry(run->hand, &arena, &batch[b], &sw->rng);
+                nums[b] = batch[b].concatenated_num;
+            }
+            is_prime_batch(nums, PRIME_BATCH, prime);
+            for (int b = 0; b < PRIME_BATCH; b++) {
+                int size = batch[b].elements_size;
+                if (size == 0) continue;
+                int digits = 0;
+                for (int i = 0; i < size; i++) digits += arena_get(&arena, batch[b].offset + i) >= 10 ? 2 : 1;
+                local.by_cards[size].trials++;
+                local.by_cards[size].hits += prime[b];
+                local.by_digits[digits].trials++;
+                local.by_digits[digits].hits += prime[b];
+            }
+        }
+        local.samples = STATS_CHUNK;
+
+        pthread_mutex_lock(&run->lock);
+        if (!atomic_load(&run->done)) {
+            StatsTable* t = &run->table;
+            merge_tallies(t->by_cards, local.by_cards, STATS_MAX_CARDS + 1);
+            merge_tallies(t->by_digits, local.by_digits, 2 * STATS_MAX_CARDS + 1);
+            t->samples += local.samples;
+            run->converged = tallies_converged(t->by_cards, STATS_MAX_CARDS + 1, t->samples, run->eps) &&
+                             tallies_converged(t->by_digits, 2 * STATS_MAX_CARDS + 1, t->samples, run->eps);
+            if (run->converged || (run->budget && t->samples >= run->budget)) atomic_store(&run->done, true);
+        }
+        pthread_mutex_unlock(&run->lock);
+    }
+    free(arena.bytes);
+    return NULL;
+}
+
+static void print_tallies(const Tally* tallies, int count, const char* unit) {
+    for (int i = 1; i < count; i++) {
+        if (tallies[i].trials == 0) continue;
+        double center, half = wilson_half_width(&tallies[i], &center);
+        printf("%2d%s: %.4f [%.4f, %.4f] %llu/%llu\n", i, unit,
+               (double)tallies[i].hits / tallies[i].trials, center - half, center + half,
+               tallies[i].hits, tallies[i].trials);
+    }
+}
+
+int run_stats(const char* text, double eps, unsigned long long budget, int threads) {
+    HandTemplate hand;
+    parse_template(text, &hand);
+    if (hand.size > STATS_MAX_CARDS) {
+        fprintf(stderr, "--stats supports up to %d cards\n", STATS_MAX_CARDS);
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    StatsRun run;
+    memset(&run, 0, sizeof(run));
+    run.hand = &hand;
+    run.eps = eps;
+    run.budget = budget;
+    pthread_mutex_init(&run.lock, NULL);
+    atomic_init(&run.done, false);
+
+    StatsWorker* workers = malloc(threads * sizeof(StatsWorker));
+    uint64_t seed = time(NULL);
+    for (int i = 0; i < threads; i++) {
+        workers[i].run = &run;
+        workers[i].rng = (seed + 1) * 0x9E3779B97F4A7C15ULL + i;
+        if (i > 0) pthread_create(&workers[i].thread, NULL, stats_worker, &workers[i]);
+    }
+    stats_worker(&workers[0]);
+    for (int i = 1; i < threads; i++) pthread_join(workers[i].thread, NULL);
+
+    print_tallies(run.table.by_cards, STATS_MAX_CARDS + 1, "枚");
+    print_tallies(run.table.by_digits, 2 * STATS_MAX_CARDS + 1, "桁");
+    fprintf(stderr, "%llu samples on %d threads in %.0f ms, %s\n", run.table.samples, threads,
+            elapsed_ms(&start), run.converged ? "precision reached" : "budget exhausted");
+    pthread_mutex_destroy(&run.lock);
+    free(workers);
     return 0;
 }
 
+// Adaptive mode (--adaptive): the copies of each rank come from a learned
+// distribution per (rank, copies held) instead of scaledrand(), and the
+// last card from a learned tail distribution instead of a uniform
+// shuffle. Multisets that can never be prime (digit sum divisible by 3,
+// no odd last card, too many digits) are redrawn without being tested.
+// After every round the distributions step toward the draws that found a
+// new prime (cross-entropy update); every draw mixes in ADAPT_FLOOR of the
+// plain distribution so no region is ever dropped. The likelihood ratios
+// p/q give unbiased estimates of the plain sampler's hit rates.
+#define ADAPT_ROUND 4096
+#define ADAPT_MAX_COPIES 8     // ranks held more often keep scaledrand()
+#define ADAPT_RATE 0.3
+#define ADAPT_FLOOR 0.1
+#define ADAPT_MAX_CARDS 32
+
+typedef struct {
+    uint8_t held[14];          // copies available, jokers included
+    uint8_t copies[14];
+    uint8_t tail;
+    double weight;             // p/q of the whole draw
+} AdaptDraw;
+
+typedef struct {
+    double plain[ADAPT_MAX_COPIES + 1][ADAPT_MAX_COPIES + 1];           // p(s | c)
+    double learned[14][ADAPT_MAX_COPIES + 1][ADAPT_MAX_COPIES + 1];     // q(s | rank, c)
+    double tail[14];
+    double elite_copies[14][ADAPT_MAX_COPIES + 1][ADAPT_MAX_COPIES + 1];
+    double elite_tail[14];
+    unsigned long long round_draws;
+    AdaptDraw draws[PRIME_BATCH];
+
+    // Estimates of the plain sampler, per card count
+    double est_hits[ADAPT_MAX_CARDS + 1], est_mass[ADAPT_MAX_CARDS + 1];
+    double est_sum, est_sum_sq;
+    unsigned long long attempts, redrawn, tested;
+
+    // Primes seen so far; only new ones count as elite
+    unsigned long long* seen;
+    size_t seen_capacity, seen_count;
+} Sampler;
+
+static const int DIGIT_SUMS[14] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 1, 2, 3, 4};
+
+static bool odd_tail(int r) {
+    return r == 1 || r == 3 || r == 7 || r == 9 || r == 11 || r == 13;
+}
+
+void sampler_init(Sampler* s) {
+    memset(s, 0, sizeof(*s));
+    // scaledrand(c) is max(a, b), a uniform on 0..c and b on 0..c-1
+    for (int c = 1; c <= ADAPT_MAX_COPIES; c++) {
+        double below = 0;
+        for (int v = 0; v <= c; v++) {
+            double cdf = (v + 1.0) / (c + 1) * (v + 1 < c ? v + 1.0 : c) / c;
+            s->plain[c][v] = cdf - below;
+            below = cdf;
+        }
+    }
+    for (int r = 0; r < 14; r++) {
+        memcpy(s->learned[r], s->plain, sizeof(s->plain));
+        s->tail[r] = 1.0 / 14;
+    }
+    s->seen_capacity = 1 << 12;
+    s->seen = calloc(s->seen_capacity, sizeof(unsigned long long));
+}
+
+void sampler_free(Sampler* s) {
+    free(s->seen);
+}
+
+// Inserts p; true if it was not there yet
+static bool seen_add(Sampler* s, unsigned long long p) {
+    if (2 * (s->seen_count + 1) > s->seen_capacity) {
+        unsigned long long* old = s->seen;
+        size_t old_capacity = s->seen_capacity;
+        s->seen_capacity *= 2;
+        s->seen = calloc(s->seen_capacity, sizeof(unsigned long long));
+        s->seen_count = 0;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i]) seen_add(s, old[i]);
+        }
+        free(old);
+    }
+    size_t j = (p * 0x9E3779B97F4A7C15ULL >> 20) & (s->seen_capacity - 1);
+    while (s->seen[j] && s->seen[j] != p) j = (j + 1) & (s->seen_capacity - 1);
+    if (s->seen[j]) return false;
+    s->seen[j] = p;
+    s->seen_count++;
+    return true;
+}
+
+static int draw_from(const double* q, int count, uint64_t* rng) {
+    double u = next_random(rng) / 4294967296.0, acc = 0;
+    for (int v = 0; v < count - 1; v++) {
+        acc += q[v];
+        if (u < acc) return v;
+    }
+    return count - 1;
+}
+
+// Like generate_entry(), drawing from the learned distributions into slot
+// `slot` of the current batch
+void adaptive_entry(Sampler* s, const HandTemplate* hand, CardArena* arena, PrimeEntry* entry, int slot, uint64_t* rng) {
+    AdaptDraw* d = &s->draws[slot];
+    int size, digits, digit_sum;
+    for (;;) {
+        int counts[14];
+        memcpy(counts, hand->counts, sizeof(counts));
+        for (int j = 0; j < hand->jokers; j++) counts[next_random(rng) % 14]++;
+
+        d->weight = 1;
+        size = digits = digit_sum = 0;
+        for (int r = 0; r < 14; r++) {
+            int c = counts[r], v;
+            d->held[r] = c;
+            if (c == 0) {
+                v = 0;
+            } else if (c > ADAPT_MAX_COPIES) {
+                v = scaledrand_r(c, rng);
+            } else {
+                double q[ADAPT_MAX_COPIES + 1];
+                for (int i = 0; i <= c; i++) q[i] = (1 - ADAPT_FLOOR) * s->learned[r][c][i] + ADAPT_FLOOR * s->plain[c][i];
+                v = draw_from(q, c + 1, rng);
+                d->weight *= s->plain[c][v] / q[v];
+            }
+            d->copies[r] = v;
+            size += v;
+            digits += v * (r >= 10 ? 2 : 1);
+            digit_sum += v * DIGIT_SUMS[r];
+        }
+        s->attempts++;
+        if (size <= ADAPT_MAX_CARDS) s->est_mass[size] += d->weight;
+
+        bool live = size == 1;
+        if (size > 1 && digit_sum % 3 != 0 && digits <= 20) {
+            for (int r = 0; r < 14; r++) live |= d->copies[r] && odd_tail(r);
+        }
+        if (live) break;
+        s->redrawn++;
+    }
+
+    // Last card: copies * learned tail weight, mixed with the plain
+    // (copies-proportional) choice among the odd ranks
+    int tail = 0;
+    if (size == 1) {
+        for (int r = 0; r < 14; r++) {
+            if (d->copies[r]) tail = r;
+        }
+    } else {
+        double q[14], learned_total = 0, odd_total = 0;
+        for (int r = 0; r < 14; r++) {
+            bool ok = d->copies[r] && odd_tail(r);
+            learned_total += ok ? d->copies[r] * s->tail[r] : 0;
+            odd_total += ok ? d->copies[r] : 0;
+        }
+        for (int r = 0; r < 14; r++) {
+            bool ok = d->copies[r] && odd_tail(r);
+            q[r] = ok ? (1 - ADAPT_FLOOR) * d->copies[r] * s->tail[r] / learned_total +
+                        ADAPT_FLOOR * d->copies[r] / odd_total : 0;
+        }
+        tail = draw_from(q, 14, rng);
+        while (q[tail] == 0) tail--;   // rounding at the top of the range
+        d->weight *= (double)d->copies[tail] / size / q[tail];
+    }
+    d->tail = tail;
+
+    uint8_t elements[size + 1];
+    int n = 0;
+    for (int r = 0; r < 14; r++) {
+        for (int j = 0; j < d->copies[r] - (r == tail); j++) elements[n++] = r;
+    }
+    for (int i = 0; i < n - 1; i++) {
+        int j = i + next_random(rng) % (n - i);
+        uint8_t temp = elements[j];
+        elements[j] = elements[i];
+        elements[i] = temp;
+    }
+    elements[n++] = tail;
+
+    unsigned long long num = 0;
+    uint64_t key = 0;
+    bool overflow = false;
+    entry->offset = arena->size;
+    entry->elements_size = size;
+    for (int i = 0; i < size; i++) {
+        int r = elements[i];
+        arena_push(arena, r);
+        key += 1ULL << (4 * r);
+        overflow |= __builtin_mul_overflow(num, r >= 10 ? 100 : 10, &num);
+        overflow |= __builtin_add_overflow(num, r, &num);
+    }
+    entry->concatenated_num = overflow ? ULLONG_MAX : num;
+    entry->key = key;
+}
+
+// Tallies a tested batch; every ADAPT_ROUND draws the learned
+// distributions move toward the draws that found new primes
+void adaptive_observe(Sampler* s, const unsigned long long* nums, const bool* prime, int count) {
+    for (int b = 0; b < count; b++) {
+        const AdaptDraw* d = &s->draws[b];
+        s->tested++;
+        if (!prime[b]) continue;
+        int size = 0;
+        for (int r = 0; r < 14; r++) size += d->copies[r];
+        if (size <= ADAPT_MAX_CARDS) s->est_hits[size] += d->weight;
+        s->est_sum += d->weight;
+        s->est_sum_sq += d->weight * d->weight;
+        if (!seen_add(s, nums[b])) continue;
+        for (int r = 0; r < 14; r++) {
+            int c = d->held[r];
+            if (c > 0 && c <= ADAPT_MAX_COPIES) s->elite_copies[r][c][d->copies[r]]++;
+        }
+        if (size > 1) s->elite_tail[d->tail]++;
+    }
+
+    s->round_draws += count;
+    if (s->round_draws < ADAPT_ROUND) return;
+    s->round_draws = 0;
+    for (int r = 0; r < 14; r++) {
+        for (int c = 1; c <= ADAPT_MAX_COPIES; c++) {
+            double total = 0;
+            for (int v = 0; v <= c; v++) total += s->elite_copies[r][c][v];
+            if (total == 0) continue;
+            for (int v = 0; v <= c; v++) {
+                s->learned[r][c][v] += ADAPT_RATE * (s->elite_copies[r][c][v] / total - s->learned[r][c][v]);
+            }
+        }
+    }
+    double tail_total = 0;
+    for (int r = 0; r < 14; r++) tail_total += s->elite_tail[r];
+    if (tail_total > 0) {
+        for (int r = 0; r < 14; r++) s->tail[r] += ADAPT_RATE * (s->elite_tail[r] / tail_total - s->tail[r]);
+    }
+    memset(s->elite_copies, 0, sizeof(s->elite_copies));
+    memset(s->elite_tail, 0, sizeof(s->elite_tail));
+}
+
+void adaptive_report(const Sampler* s) {
+    // Hit rate of the plain sampler: mean of hit * p/q over every draw,
+    // the redrawn dead ones included as zeros
+    double n = s->attempts, mean = s->est_sum / n;
+    double se = sqrt((s->est_sum_sq / n - mean * mean) / n);
+    fprintf(stderr, "adaptive: %zu distinct primes in %llu tests (%.4f per test), %llu dead draws skipped\n",
+            s->seen_count, s->tested, s->seen_count / (double)s->tested, s->redrawn);
+    fprintf(stderr, "plain hit rate estimate: %.5f +- %.5f\n", mean, STATS_Z * se);
+    for (int k = 1; k <= ADAPT_MAX_CARDS; k++) {
+        if (s->est_mass[k] > 0) fprintf(stderr, "%2d枚: %.5f\n", k, s->est_hits[k] / s->est_mass[k]);
+    }
+}
+
 int main(int argc, char** argv) {
+    // --deadline-ms=T switches to the anytime search; n then caps the number
+    // of candidates tested (0 for no cap)
+    long deadline_ms = -1;
+    double stats_eps = 0;
+    bool adaptive = false;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    static Output out = {.format = FORMAT_TEXT, .echo = true};
+    ResultSink sink = {0};
+    int argn = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--deadline-ms=", 14) == 0) {
+            deadline_ms = atol(argv[i] + 14);
+        } else if (strncmp(argv[i], "--stats=", 8) == 0) {
+            stats_eps = atof(argv[i] + 8);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = true;
+        } else if (strncmp(argv[i], "--top=", 6) == 0) {
+            sink.top = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--run-size=", 11) == 0) {
+            sink.run_size = strtoull(argv[i] + 11, NULL, 10);
+        } else if (!parse_output_flag(argv[i], &out)) {
+            argv[argn++] = argv[i];
+        }
+    }
+    argc = argn;
+    if (threads < 1) threads = 1;
+
     if (argc < 2) {
         fprintf(stderr, "素数v2:\n");
-        fprintf(stderr, "Usage: %s n [カード]\n", argv[0]);
+        fprintf(stderr, "Usage: %s n [カード] [--deadline-ms=T] [--adaptive] [--top=K] [--run-size=N] [--format=text|ndjson|binary] [--no-echo]\n", argv[0]);
+        fprintf(stderr, "       %s n [カード] --stats=EPS [--threads=N]\n", argv[0]);
         return 1;
     }
     int n = atoi(argv[1]);
     char* text = (argc >= 3) ? argv[2] : "A23456789TJQK";
     srand(time(NULL));
 
-    PrimeEntry* primes = NULL;
-    size_t primes_size = 0;
+    if (deadline_ms >= 0) {
+        run_deadline(&out, text, deadline_ms, n > 0 ? n : 0, false);
+        return 0;
+    }
+    if (stats_eps > 0) return run_stats(text, stats_eps, n > 0 ? n : 0, threads);
+
+    HandTemplate hand;
+    parse_template(text, &hand);
+    uint64_t rng = (uint64_t)time(NULL) * 0x9E3779B97F4A7C15ULL | 1;
 
-    for (int i = 0; i < n; i++) {
-        int* elements;
-        int elements_size;
-        generate(text, &elements, &elements_size);
+    CardArena batch_cards = {0};  // sequences of the current batch
+    static Sampler sampler;
+    if (adaptive) sampler_init(&sampler);
 
-        char* concat = concatenate_numbers(elements, elements_size);
-        unsigned long long num = strtoull(concat, NULL, 10);
+    PrimeEntry batch[PRIME_BATCH];
+    unsigned long long batch_nums[PRIME_BATCH];
+    bool batch_prime[PRIME_BATCH];
 
-        if (is_prime(num, 40)) {
-            printf("Found prime: ");
-            print_comma_separated(elements, elements_size);
-            printf(" -> %llu\n", num);
+    for (int i = 0; i < n; i += PRIME_BATCH) {
+        int batch_count = (n - i < PRIME_BATCH) ? n - i : PRIME_BATCH;
+        batch_cards.size = 0;
+        for (int b = 0; b < batch_count; b++) {
+            if (adaptive) {
+                adaptive_entry(&sampler, &hand, &batch_cards, &batch[b], b, &rng);
+            } else {
+                generate_entry(&hand, &batch_cards, &batch[b], &rng);
+            }
+            batch_nums[b] = batch[b].concatenated_num;
+        }
+        is_prime_batch(batch_nums, batch_count, batch_prime);
+        if (adaptive) adaptive_observe(&sampler, batch_nums, batch_prime, batch_count);
 
-            primes = realloc(primes, (primes_size + 1) * sizeof(PrimeEntry));
-            primes[primes_size].elements = elements;
-            primes[primes_size].elements_size = elements_size;
-            primes[primes_size].concatenated_num = num;
-            primes_size++;
-        } else {
-            free(elements);
+        for (int b = 0; b < batch_count; b++) {
+            if (!batch_prime[b]) continue;
+            if (out.echo) out_entry(&out, "Found prime: ", &batch_cards, &batch[b]);
+            sink_add(&sink, &batch_cards, &batch[b]);
         }
-        free(concat);
     }
 
-    if (primes_size > 0) {
-        qsort(primes, primes_size, sizeof(PrimeEntry), compare_prime_entries);
-        
-        printf("\nSorted primes:\n");
-        for (size_t i = 0; i < primes_size; i++) {
-            print_comma_separated(primes[i].elements, primes[i].elements_size);
-            printf(" -> %llu\n", primes[i].concatenated_num);
+    // Structured formats write each prime once: as found, or with
+    // --no-echo as part of the sorted set
+    if (!out.echo || out.format == FORMAT_TEXT) {
+        if (sink.total > 0) {
+            if (out.format == FORMAT_TEXT) out_str(&out, out.echo ? "\nSorted primes:\n" : "Sorted primes:\n");
+            sink_write(&sink, &out);
+        } else if (out.format == FORMAT_TEXT) {
+            out_str(&out, out.echo ? "\nNo primes found.\n" : "No primes found.\n");
         }
-    } else {
-        printf("\nNo primes found.\n");
+    }
+    out_flush(&out);
+    if (adaptive) {
+        adaptive_report(&sampler);
+        sampler_free(&sampler);
     }
 
     // Clean up
-    for (size_t i = 0; i < primes_size; i++) {
-        free(primes[i].elements);
-    }
-    free(primes);
+    free(batch_cards.bytes);
+    sink_free(&sink);
 
     return 0;
 }
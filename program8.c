@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+#define MAX_HAND 64
+#define MAX_NUMBER_DIGITS 19  // every 19-digit number fits in 64 bits
+#define DEFAULT_MAX_CARDS 5
+#define MAX_FACTORS 16        // 64-bit numbers have at most 15 distinct primes
+#define TRIAL_LIMIT 1000
+
+typedef struct {
+    unsigned long long n;
+    uint8_t count;
+    uint8_t exponents[MAX_FACTORS];
+    unsigned long long primes[MAX_FACTORS];
+} FlatFactorization;
+
+// Memo of factorizations shared by every card sequence that spells the same N
+typedef struct {
+    FlatFactorization *slots; // n == 0 marks an empty slot
+    size_t capacity;
+    size_t size;
+    unsigned long long hits, misses;
+} FactorMemo;
+
+typedef struct {
+    unsigned long long n;
+    uint64_t key;             // rank counts of N's cards, 4 bits per rank
+    uint8_t n_cards[MAX_NUMBER_DIGITS];
+    uint8_t n_len;
+    uint8_t factor_cards[2 * MAX_NUMBER_DIGITS + 2 * MAX_FACTORS];
+    uint8_t factor_len;
+} Play;
+
+typedef struct {
+    int counts[14];           // cards still in hand
+    int total;                // sum of counts
+    int max_cards;
+    uint8_t seq[MAX_NUMBER_DIGITS];
+    FactorMemo memo;
+    Play *plays;
+    size_t play_count, play_capacity;
+    uint64_t *seen;           // (N, key) pairs already reported
+    size_t seen_capacity, seen_size;
+    unsigned long long candidates;
+} Solver;
+
+static int card_digits(int rank) {
+    return rank >= 10 ? 2 : 1;
+}
+
+static unsigned long long gcd_u64(unsigned long long a, unsigned long long b) {
+    while (b) {
+        unsigned long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// x^2 + c in Montgomery form, kept below n
+static inline unsigned long long rho_step(unsigned long long x, unsigned long long c,
+                                          unsigned long long n, unsigned long long ninv) {
+    unsigned long long y = mont_mul(x, x, n, ninv) + c;
+    return y >= n ? y - n : y;
+}
+
+// Brent's variant of Pollard's rho in Montgomery form; n odd composite
+unsigned long long pollard_brent(unsigned long long n) {
+    unsigned long long ninv = mont_inverse(n);
+    for (unsigned long long c = 1;; c++) {
+        unsigned long long y = 2, x = 2, ys = 2, q = 1, g = 1;
+        size_t r = 1;
+        const size_t m = 128;
+        do {
+            x = y;
+            for (size_t i = 0; i < r; i++) y = rho_step(y, c, n, ninv);
+            for (size_t k = 0; k < r && g == 1; k += m) {
+                ys = y;
+                for (size_t i = 0; i < m && i < r - k; i++) {
+                    y = rho_step(y, c, n, ninv);
+                    q = mont_mul(q, x > y ? x - y : y - x, n, ninv);
+                }
+                g = gcd_u64(q, n);
+            }
+            r *= 2;
+        } while (g == 1);
+
+        if (g == n) {
+            do {
+                ys = rho_step(ys, c, n, ninv);
+                g = gcd_u64(x > ys ? x - ys : ys - x, n);
+            } while (g == 1);
+        }
+        if (g != n) return g;
+    }
+}
+
+static void add_prime(FlatFactorization *f, unsigned long long p, int exponent) {
+    for (int i = 0; i < f->count; i++) {
+        if (f->primes[i] == p) {
+            f->exponents[i] += exponent;
+            return;
+        }
+    }
+    f->primes[f->count] = p;
+    f->exponents[f->count] = exponent;
+    f->count++;
+}
+
+static void factor_rest(FlatFactorization *f, unsigned long long n) {
+    if (n == 1) return;
+    if (n < (unsigned long long)TRIAL_LIMIT * TRIAL_LIMIT || is_prime(n)) {
+        add_prime(f, n, 1);
+        return;
+    }
+    unsigned long long d = pollard_brent(n);
+    factor_rest(f, d);
+    factor_rest(f, n / d);
+}
+
+void factorize(unsigned long long n, FlatFactorization *f) {
+    f->n = n;
+    f->count = 0;
+    for (unsigned long long p = 2; p < TRIAL_LIMIT && p * p <= n; p += (p == 2) ? 1 : 2) {
+        int e = 0;
+        while (n % p == 0) {
+            n /= p;
+            e++;
+        }
+        if (e) add_prime(f, p, e);
+    }
+    factor_rest(f, n);
+
+    // Ascending primes, the order the play is written in
+    for (int i = 1; i < f->count; i++) {
+        for (int j = i; j > 0 && f->primes[j - 1] > f->primes[j]; j--) {
+            unsigned long long tp = f->primes[j];
+            f->primes[j] = f->primes[j - 1];
+            f->primes[j - 1] = tp;
+            uint8_t te = f->exponents[j];
+            f->exponents[j] = f->exponents[j - 1];
+            f->exponents[j - 1] = te;
+        }
+    }
+}
+
+static size_t hash_u64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+void memo_init(FactorMemo *m) {
+    m->capacity = 1 << 12;
+    m->size = 0;
+    m->slots = calloc(m->capacity, sizeof(FlatFactorization));
+    m->hits = m->misses = 0;
+}
+
+static void memo_grow(FactorMemo *m) {
+    FlatFactorization *old = m->slots;
+    size_t old_capacity = m->capacity;
+    m->capacity *= 2;
+    m->slots = calloc(m->capacity, sizeof(FlatFactorization));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].n == 0) continue;
+        size_t j = hash_u64(old[i].n) & (m->capacity - 1);
+        while (m->slots[j].n) j = (j + 1) & (m->capacity - 1);
+        m->slots[j] = old[i];
+    }
+    free(old);
+}
+
+// Returns the factorization of n, computing it on first use. Slots move
+// when the table grows, so callers must not keep the pointer across calls.
+const FlatFactorization *memo_factorize(FactorMemo *m, unsigned long long n) {
+    size_t j = hash_u64(n) & (m->capacity - 1);
+    while (m->slots[j].n) {
+        if (m->slots[j].n == n) {
+            m->hits++;
+            return &m->slots[j];
+        }
+        j = (j + 1) & (m->capacity - 1);
+    }
+    m->misses++;
+    if (2 * (m->size + 1) > m->capacity) {
+        memo_grow(m);
+        j = hash_u64(n) & (m->capacity - 1);
+        while (m->slots[j].n) j = (j + 1) & (m->capacity - 1);
+    }
+    factorize(n, &m->slots[j]);
+    m->size++;
+    return &m->slots[j];
+}
+
+// Spells strings[idx] from position pos onwards, then the strings after
+// it, with cards from counts; backtracks over the 1 / 10-13 ambiguity
+static bool cover_strings(char strings[][24], int count, int idx, int pos,
+                          int *counts, uint8_t *out, int *out_len) {
+    if (idx == count) return true;
+    const char *s = strings[idx] + pos;
+    if (*s == '\0') return cover_strings(strings, count, idx + 1, 0, counts, out, out_len);
+    if (*s == '0') return false;
+
+    int d = *s - '0';
+    if (counts[d] > 0) {
+        counts[d]--;
+        out[(*out_len)++] = d;
+        if (cover_strings(strings, count, idx, pos + 1, counts, out, out_len)) return true;
+        (*out_len)--;
+        counts[d]++;
+    }
+    if (d == 1 && s[1] >= '0' && s[1] <= '3') {
+        int r = 10 + (s[1] - '0');
+        if (counts[r] > 0) {
+            counts[r]--;
+            out[(*out_len)++] = r;
+            if (cover_strings(strings, count, idx, pos + 2, counts, out, out_len)) return true;
+            (*out_len)--;
+            counts[r]++;
+        }
+    }
+    return false;
+}
+
+// Checks whether the remaining cards can spell every prime and exponent > 1
+bool cover_factorization(const FlatFactorization *f, const int *remaining, uint8_t *out, int *out_len) {
+    char strings[2 * MAX_FACTORS][24];
+    int count = 0;
+    int need[10] = {0};
+    for (int i = 0; i < f->count; i++) {
+        snprintf(strings[count++], sizeof(strings[0]), "%llu", f->primes[i]);
+        if (f->exponents[i] > 1) {
+            snprintf(strings[count++], sizeof(strings[0]), "%u", f->exponents[i]);
+        }
+    }
+
+    // Digit multiset containment first: cheap and rejects most candidates
+    int have[10] = {0};
+    for (int r = 1; r <= 13; r++) {
+        if (r < 10) {
+            have[r] += remaining[r];
+        } else {
+            have[1] += remaining[r];
+            have[r - 10] += remaining[r];
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        for (const char *p = strings[i]; *p; p++) need[*p - '0']++;
+    }
+    for (int d = 0; d < 10; d++) {
+        if (need[d] > have[d]) return false;
+    }
+
+    int counts[14];
+    memcpy(counts, remaining, sizeof(counts));
+    *out_len = 0;
+    return cover_strings(strings, count, 0, 0, counts, out, out_len);
+}
+
+static bool seen_insert(Solver *s, unsigned long long n, uint64_t key) {
+    if (2 * (s->seen_size + 1) > s->seen_capacity) {
+        uint64_t *old = s->seen;
+        size_t old_capacity = s->seen_capacity;
+        s->seen_capacity = old_capacity ? old_capacity * 2 : 1 << 12;
+        s->seen = calloc(2 * s->seen_capacity, sizeof(uint64_t));
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[2 * i] == 0) continue;
+            size_t j = hash_u64(old[2 * i] ^ old[2 * i + 1]) & (s->seen_capacity - 1);
+            while (s->seen[2 * j]) j = (j + 1) & (s->seen_capacity - 1);
+            s->seen[2 * j] = old[2 * i];
+            s->seen[2 * j + 1] = old[2 * i + 1];
+        }
+        free(old);
+    }
+    size_t j = hash_u64(n ^ key) & (s->seen_capacity - 1);
+    while (s->seen[2 * j]) {
+        if (s->seen[2 * j] == n && s->seen[2 * j + 1] == key) return false;
+        j = (j + 1) & (s->seen_capacity - 1);
+    }
+    s->seen[2 * j] = n;
+    s->seen[2 * j + 1] = key;
+    s->seen_size++;
+    return true;
+}
+
+static void try_play(Solver *s, unsigned long long n, int len, uint64_t key) {
+    s->candidates++;
+    if (n < 4 || is_prime(n)) return;
+
+    const FlatFactorization *f = memo_factorize(&s->memo, n);
+    // A factorization needs at least one card per prime and exponent
+    int min_cards = f->count;
+    for (int i = 0; i < f->count; i++) min_cards += f->exponents[i] > 1;
+    if (min_cards > s->total) return;
+
+    Play play;
+    int factor_len;
+    if (!cover_factorization(f, s->counts, play.factor_cards, &factor_len)) return;
+    if (!seen_insert(s, n, key)) return;
+
+    play.n = n;
+    play.key = key;
+    play.n_len = len;
+    memcpy(play.n_cards, s->seq, len);
+    play.factor_len = factor_len;
+    if (s->play_count == s->play_capacity) {
+        s->play_capacity = s->play_capacity ? s->play_capacity * 2 : 64;
+        s->plays = realloc(s->plays, s->play_capacity * sizeof(Play));
+    }
+    s->plays[s->play_count++] = play;
+}
+
+// Prefix DFS over distinct rank sequences; N's value is built incrementally
+void search(Solver *s, int depth, unsigned long long value, int digits, uint64_t key) {
+    if (depth > 0) try_play(s, value, depth, key);
+    // Leave at least two cards for the factorization
+    if (depth >= s->max_cards || s->total <= 2) return;
+
+    for (int r = 1; r <= 13; r++) {
+        if (s->counts[r] == 0) continue;
+        int len = card_digits(r);
+        if (digits + len > MAX_NUMBER_DIGITS) continue;
+
+        s->counts[r]--;
+        s->total--;
+        s->seq[depth] = r;
+        search(s, depth + 1, value * (len == 2 ? 100 : 10) + r, digits + len, key + (1ULL << (4 * r)));
+        s->total++;
+        s->counts[r]++;
+    }
+}
+
+void print_cards(const uint8_t *cards, int len) {
+    for (int i = 0; i < len; i++) {
+        printf("%d", cards[i]);
+        if (i < len - 1) {
+            printf(",");
+        }
+    }
+}
+
+int compare_plays(const void *a, const void *b) {
+    const Play *pa = a;
+    const Play *pb = b;
+    int ca = pa->n_len + pa->factor_len;
+    int cb = pb->n_len + pb->factor_len;
+    if (ca != cb) return cb - ca;
+    if (pa->n != pb->n) return pa->n < pb->n ? 1 : -1;
+    return pa->key < pb->key ? -1 : pa->key > pb->key;
+}
+
+int main(int argc, char **argv) {
+    int max_cards = DEFAULT_MAX_CARDS;
+    const char *text = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--max-cards=", 12) == 0) {
+            max_cards = atoi(argv[i] + 12);
+        } else {
+            text = argv[i];
+        }
+    }
+    if (!text) {
+        fprintf(stderr, "合成数出し:\n");
+        fprintf(stderr, "Usage: %s [--max-cards=K] カード\n", argv[0]);
+        return 1;
+    }
+
+    Solver s;
+    memset(&s, 0, sizeof(s));
+    s.max_cards = max_cards < MAX_NUMBER_DIGITS ? max_cards : MAX_NUMBER_DIGITS;
+    for (const char *p = text; *p != '\0'; p++) {
+        int r = parse_card(*p);
+        // 4 bits per rank in the play key
+        if (r > 0 && s.total < MAX_HAND && s.counts[r] < 15) {
+            s.counts[r]++;
+            s.total++;
+        }
+    }
+    memo_init(&s.memo);
+
+    search(&s, 0, 0, 0, 0);
+
+    qsort(s.plays, s.play_count, sizeof(Play), compare_plays);
+    for (size_t i = 0; i < s.play_count; i++) {
+        Play *p = &s.plays[i];
+        const FlatFactorization *f = memo_factorize(&s.memo, p->n);
+        print_cards(p->n_cards, p->n_len);
+        printf(" -> %llu = ", p->n);
+        for (int j = 0; j < f->count; j++) {
+            if (j > 0) printf("*");
+            printf("%llu", f->primes[j]);
+            if (f->exponents[j] > 1) printf("^%u", f->exponents[j]);
+        }
+        printf(" [");
+        print_cards(p->factor_cards, p->factor_len);
+        printf("]\n");
+    }
+
+    fprintf(stderr, "%zu plays, %llu candidates, %zu factorizations (%llu shared)\n",
+            s.play_count, s.candidates, s.memo.size, s.memo.hits);
+
+    free(s.plays);
+    free(s.seen);
+    free(s.memo.slots);
+    return 0;
+}
@@ -0,0 +1,578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+#define MAX_NUMBER_DIGITS 19  // every 19-digit number fits in 64 bits
+#define DEFAULT_MAX_CARDS 7
+#define MAX_RANK_COUNT 15     // 4 bits per rank in a hand key
+
+// Primes formable from exactly one sub-multiset of the hand
+typedef struct {
+    uint64_t key;             // 0 marks an empty slot
+    unsigned long long* primes;
+    int count, capacity;
+} SubsetEntry;
+
+// Per-sub-multiset prime sets for the current hand, kept up to date one
+// card at a time
+typedef struct {
+    int counts[14];
+    int total;
+    int max_cards;
+    SubsetEntry* slots;
+    size_t capacity, size;
+    unsigned long long tested;   // candidates run through the primality test
+
+    // DFS state
+    int seq[MAX_NUMBER_DIGITS];
+    int used[14];
+    int required_rank;           // -1, or a rank every arrangement must use up
+    unsigned long long batch_nums[PRIME_BATCH];
+    uint64_t batch_keys[PRIME_BATCH];
+    int batch_count;
+} Analysis;
+
+static size_t hash_key(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+static SubsetEntry* find_slot(SubsetEntry* slots, size_t capacity, uint64_t key) {
+    size_t j = hash_key(key) & (capacity - 1);
+    while (slots[j].key && slots[j].key != key) j = (j + 1) & (capacity - 1);
+    return &slots[j];
+}
+
+static void rehash(Analysis* a, size_t capacity) {
+    SubsetEntry* old = a->slots;
+    size_t old_capacity = a->capacity;
+    a->slots = calloc(capacity, sizeof(SubsetEntry));
+    a->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].key) *find_slot(a->slots, capacity, old[i].key) = old[i];
+    }
+    free(old);
+}
+
+static SubsetEntry* add_subset(Analysis* a, uint64_t key) {
+    if (2 * (a->size + 1) > a->capacity) rehash(a, a->capacity * 2);
+    SubsetEntry* e = find_slot(a->slots, a->capacity, key);
+    if (!e->key) {
+        e->key = key;
+        a->size++;
+    }
+    return e;
+}
+
+static void entry_add_prime(SubsetEntry* e, unsigned long long p) {
+    // [1,11] and [11,1] spell the same number from the same cards
+    for (int i = 0; i < e->count; i++) {
+        if (e->primes[i] == p) return;
+    }
+    if (e->count == e->capacity) {
+        e->capacity = e->capacity ? e->capacity * 2 : 4;
+        e->primes = realloc(e->primes, e->capacity * sizeof(unsigned long long));
+    }
+    e->primes[e->count++] = p;
+}
+
+void add_prime(Analysis* a, uint64_t key, unsigned long long p) {
+    entry_add_prime(add_subset(a, key), p);
+}
+
+static void flush_batch(Analysis* a) {
+    bool prime[PRIME_BATCH];
+    is_prime_batch(a->batch_nums, a->batch_count, prime);
+    for (int b = 0; b < a->batch_count; b++) {
+        if (prime[b]) add_prime(a, a->batch_keys[b], a->batch_nums[b]);
+    }
+    a->tested += a->batch_count;
+    a->batch_count = 0;
+}
+
+// Prefix DFS over distinct rank sequences. With a required rank, only
+// sequences that use every copy of it are tested; the rest are known.
+static void dfs(Analysis* a, int depth, unsigned long long value, int digits, uint64_t key) {
+    if (depth > 0 && (a->required_rank < 0 || a->used[a->required_rank] == a->counts[a->required_rank])) {
+        a->batch_nums[a->batch_count] = value;
+        a->batch_keys[a->batch_count] = key;
+        if (++a->batch_count == PRIME_BATCH) flush_batch(a);
+    }
+    if (depth == a->max_cards) return;
+    if (a->required_rank >= 0) {
+        // Not enough room left for the remaining copies of the required rank
+        int missing = a->counts[a->required_rank] - a->used[a->required_rank];
+        if (depth + missing > a->max_cards) return;
+    }
+
+    for (int r = 0; r < 14; r++) {
+        if (a->used[r] == a->counts[r]) continue;
+        int len = r >= 10 ? 2 : 1;
+        if (digits + len > MAX_NUMBER_DIGITS) continue;
+        a->used[r]++;
+        a->seq[depth] = r;
+        dfs(a, depth + 1, value * (len == 2 ? 100 : 10) + r, digits + len, key + KEY_ONE(r));
+        a->used[r]--;
+    }
+}
+
+static void run_dfs(Analysis* a, int required_rank) {
+    a->required_rank = required_rank;
+    memset(a->used, 0, sizeof(a->used));
+    dfs(a, 0, 0, 0, 0);
+    if (a->batch_count > 0) flush_batch(a);
+}
+
+void analysis_init(Analysis* a, int max_cards) {
+    memset(a, 0, sizeof(*a));
+    a->max_cards = max_cards < MAX_NUMBER_DIGITS ? max_cards : MAX_NUMBER_DIGITS;
+    a->capacity = 1 << 10;
+    a->slots = calloc(a->capacity, sizeof(SubsetEntry));
+}
+
+void analysis_free(Analysis* a) {
+    for (size_t i = 0; i < a->capacity; i++) free(a->slots[i].primes);
+    free(a->slots);
+}
+
+// Full recomputation for a new hand
+void analysis_set_hand(Analysis* a, const int* counts) {
+    for (size_t i = 0; i < a->capacity; i++) {
+        free(a->slots[i].primes);
+        a->slots[i] = (SubsetEntry){0};
+    }
+    a->size = 0;
+    a->total = 0;
+    for (int r = 0; r < 14; r++) {
+        a->counts[r] = counts[r];
+        a->total += counts[r];
+    }
+    run_dfs(a, -1);
+}
+
+// A drawn card only adds sub-multisets that contain the new copy, i.e. the
+// ones using every copy of its rank
+bool analysis_add_card(Analysis* a, int rank) {
+    if (a->counts[rank] == MAX_RANK_COUNT) return false;
+    a->counts[rank]++;
+    a->total++;
+    run_dfs(a, rank);
+    return true;
+}
+
+// A played card invalidates exactly the sub-multisets that needed more
+// copies of its rank than are left
+bool analysis_remove_card(Analysis* a, int rank) {
+    if (a->counts[rank] == 0) return false;
+    a->counts[rank]--;
+    a->total--;
+    size_t kept = 0;
+    for (size_t i = 0; i < a->capacity; i++) {
+        SubsetEntry* e = &a->slots[i];
+        if (!e->key) continue;
+        if (KEY_COUNT(e->key, rank) > a->counts[rank]) {
+            free(e->primes);
+            *e = (SubsetEntry){0};
+        } else {
+            kept++;
+        }
+    }
+    a->size = kept;
+    // Open addressing needs its probe chains rebuilt after deletions
+    rehash(a, a->capacity);
+    return true;
+}
+
+int compare_desc(const void* x, const void* y) {
+    unsigned long long a = *(const unsigned long long*)x;
+    unsigned long long b = *(const unsigned long long*)y;
+    return a < b ? 1 : a > b ? -1 : 0;
+}
+
+// Distinct primes per card count and the largest one
+typedef struct {
+    int per_length[MAX_NUMBER_DIGITS + 1];
+    unsigned long long best;
+    uint64_t best_key;
+} Summary;
+
+static void summary_add(Summary* s, const SubsetEntry* e) {
+    int cards = 0;
+    for (int r = 0; r < 14; r++) cards += KEY_COUNT(e->key, r);
+    s->per_length[cards] += e->count;
+    for (int j = 0; j < e->count; j++) {
+        // 111 is both AAA and AJ; the smaller key wins so the pick does
+        // not depend on table order
+        if (e->primes[j] > s->best || (e->primes[j] == s->best && e->key < s->best_key)) {
+            s->best = e->primes[j];
+            s->best_key = e->key;
+        }
+    }
+}
+
+// One line per hand
+static void summary_print(const Summary* s, uint64_t hand, int max_cards) {
+    printf("hand ");
+    print_key(hand);
+    printf(":");
+    for (int k = 1; k <= max_cards; k++) {
+        if (s->per_length[k]) printf(" %d枚=%d", k, s->per_length[k]);
+    }
+    if (s->best) {
+        printf(" best=%llu (", s->best);
+        print_key(s->best_key);
+        printf(")");
+    }
+    printf("\n");
+}
+
+void print_summary(const Analysis* a) {
+    Summary s = {0};
+    for (size_t i = 0; i < a->capacity; i++) {
+        if (a->slots[i].key) summary_add(&s, &a->slots[i]);
+    }
+    uint64_t hand = 0;
+    for (int r = 0; r < 14; r++) hand += (uint64_t)a->counts[r] << (4 * r);
+    summary_print(&s, hand, a->max_cards);
+}
+
+void print_primes(const Analysis* a) {
+    size_t total = 0;
+    for (size_t i = 0; i < a->capacity; i++) total += a->slots[i].count;
+    unsigned long long* all = malloc((total ? total : 1) * sizeof(unsigned long long));
+    size_t k = 0;
+    for (size_t i = 0; i < a->capacity; i++) {
+        memcpy(all + k, a->slots[i].primes, a->slots[i].count * sizeof(unsigned long long));
+        k += a->slots[i].count;
+    }
+    qsort(all, total, sizeof(unsigned long long), compare_desc);
+    for (size_t i = 0; i < total; i++) {
+        // Different cards can spell the same number
+        if (i == 0 || all[i] != all[i - 1]) printf("%llu\n", all[i]);
+    }
+    free(all);
+}
+
+// Batch mode: a list of hands evaluated in one pass. Hands are reduced
+// to their keys so repeats are solved once, and every distinct
+// sub-multiset of every hand is solved once no matter how many hands
+// share it. The solving runs on all cores, biggest multisets first; the
+// per-hand sums then stream out in input order.
+typedef struct {
+    int max_cards;
+    Analysis table;              // sub-multiset -> primes, shared by all hands
+    SubsetEntry** jobs;
+    size_t job_count;
+    atomic_size_t next_job;
+    size_t* line_hand;           // input line -> distinct hand
+    size_t line_count;
+    atomic_size_t next_line;
+    uint64_t* hands;
+    Summary* summaries;
+    atomic_int* state;           // per hand: 0 waiting, 1 being summed, 2 done
+    size_t hand_count;
+    _Atomic unsigned long long tested;
+} BatchRun;
+
+typedef struct {
+    BatchRun* run;
+    int left[14];
+    unsigned long long batch_nums[PRIME_BATCH];
+    SubsetEntry* batch_entries[PRIME_BATCH];
+    int batch_count;
+    unsigned long long tested;
+    pthread_t thread;
+} BatchWorker;
+
+typedef struct {
+    uint64_t key;
+    size_t line;
+} HandLine;
+
+int compare_hand_lines(const void* x, const void* y) {
+    const HandLine* a = x;
+    const HandLine* b = y;
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    return a->line < b->line ? -1 : a->line > b->line;
+}
+
+// Distinct arrangements of a multiset: k! / (c1! c2! ...)
+static double arrangements(uint64_t key) {
+    double n = 1;
+    int k = 0;
+    for (int r = 1; r <= 13; r++) {
+        for (int c = 1; c <= KEY_COUNT(key, r); c++) n = n * ++k / c;
+    }
+    return n;
+}
+
+int compare_jobs(const void* x, const void* y) {
+    double a = arrangements((*(SubsetEntry* const*)x)->key);
+    double b = arrangements((*(SubsetEntry* const*)y)->key);
+    return a < b ? 1 : a > b ? -1 : 0;
+}
+
+// Every non-empty sub-multiset of the hand within max_cards cards and
+// MAX_NUMBER_DIGITS digits
+static void for_each_subset(uint64_t hand, int max_cards, int rank, int cards, int digits, uint64_t key,
+                            void (*visit)(void*, uint64_t), void* ctx) {
+    if (rank > 13) {
+        if (key) visit(ctx, key);
+        return;
+    }
+    int len = rank >= 10 ? 2 : 1;
+    for (int n = 0; n <= KEY_COUNT(hand, rank); n++) {
+        if (cards + n > max_cards || digits + n * len > MAX_NUMBER_DIGITS) break;
+        for_each_subset(hand, max_cards, rank + 1, cards + n, digits + n * len, key + n * KEY_ONE(rank), visit, ctx);
+    }
+}
+
+static void visit_collect(void* ctx, uint64_t key) {
+    add_subset(ctx, key);
+}
+
+typedef struct {
+    const Analysis* table;
+    Summary* summary;
+} SumContext;
+
+static void visit_sum(void* ctx, uint64_t key) {
+    SumContext* s = ctx;
+    summary_add(s->summary, find_slot(s->table->slots, s->table->capacity, key));
+}
+
+static void solve_flush(BatchWorker* w) {
+    bool prime[PRIME_BATCH];
+    is_prime_batch(w->batch_nums, w->batch_count, prime);
+    for (int b = 0; b < w->batch_count; b++) {
+        if (prime[b]) entry_add_prime(w->batch_entries[b], w->batch_nums[b]);
+    }
+    w->tested += w->batch_count;
+    w->batch_count = 0;
+}
+
+static void solve_dfs(BatchWorker* w, SubsetEntry* e, int remaining, unsigned long long value) {
+    if (remaining == 0) {
+        w->batch_nums[w->batch_count] = value;
+        w->batch_entries[w->batch_count] = e;
+        if (++w->batch_count == PRIME_BATCH) solve_flush(w);
+        return;
+    }
+    for (int r = 1; r <= 13; r++) {
+        if (w->left[r] == 0) continue;
+        w->left[r]--;
+        solve_dfs(w, e, remaining - 1, value * (r >= 10 ? 100 : 10) + r);
+        w->left[r]++;
+    }
+}
+
+void* solve_worker(void* arg) {
+    BatchWorker* w = arg;
+    BatchRun* run = w->run;
+    for (;;) {
+        size_t j = atomic_fetch_add(&run->next_job, 1);
+        if (j >= run->job_count) break;
+        SubsetEntry* e = run->jobs[j];
+        int cards = 0;
+        for (int r = 1; r <= 13; r++) {
+            w->left[r] = KEY_COUNT(e->key, r);
+            cards += w->left[r];
+        }
+        solve_dfs(w, e, cards, 0);
+    }
+    if (w->batch_count > 0) solve_flush(w);
+    atomic_fetch_add(&run->tested, w->tested);
+    return NULL;
+}
+
+static bool claim_hand(BatchRun* run, size_t h) {
+    int expected = 0;
+    return atomic_compare_exchange_strong(&run->state[h], &expected, 1);
+}
+
+static void sum_hand(BatchRun* run, size_t h) {
+    SumContext ctx = {&run->table, &run->summaries[h]};
+    for_each_subset(run->hands[h], run->max_cards, 1, 0, 0, 0, visit_sum, &ctx);
+    atomic_store_explicit(&run->state[h], 2, memory_order_release);
+}
+
+// Sums hands in input order, one step ahead of the printing thread
+void* sum_worker(void* arg) {
+    BatchRun* run = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add(&run->next_line, 1);
+        if (i >= run->line_count) break;
+        size_t h = run->line_hand[i];
+        if (claim_hand(run, h)) sum_hand(run, h);
+    }
+    return NULL;
+}
+
+int run_batch(const char* path, int max_cards, int threads) {
+    FILE* fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    static BatchRun run;
+    run.max_cards = max_cards < MAX_NUMBER_DIGITS ? max_cards : MAX_NUMBER_DIGITS;
+
+    // Canonicalise: a hand is its rank counts, whatever the card order
+    HandLine* lines = NULL;
+    size_t capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!line[0]) continue;
+        int counts[14] = {0};
+        uint64_t key = 0;
+        for (const char* p = line; *p; p++) {
+            int r = parse_card(*p);
+            if (r > 0 && counts[r] < MAX_RANK_COUNT) {
+                counts[r]++;
+                key += KEY_ONE(r);
+            }
+        }
+        if (run.line_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            lines = realloc(lines, capacity * sizeof(HandLine));
+        }
+        lines[run.line_count] = (HandLine){key, run.line_count};
+        run.line_count++;
+    }
+    if (fp != stdin) fclose(fp);
+
+    qsort(lines, run.line_count, sizeof(HandLine), compare_hand_lines);
+    run.line_hand = malloc((run.line_count ? run.line_count : 1) * sizeof(size_t));
+    run.hands = malloc((run.line_count ? run.line_count : 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < run.line_count; i++) {
+        if (i == 0 || lines[i].key != lines[i - 1].key) run.hands[run.hand_count++] = lines[i].key;
+        run.line_hand[lines[i].line] = run.hand_count - 1;
+    }
+    free(lines);
+    run.summaries = calloc(run.hand_count ? run.hand_count : 1, sizeof(Summary));
+    run.state = calloc(run.hand_count ? run.hand_count : 1, sizeof(atomic_int));
+
+    // The union of every hand's sub-multisets, each one a job
+    analysis_init(&run.table, run.max_cards);
+    for (size_t h = 0; h < run.hand_count; h++) {
+        for_each_subset(run.hands[h], run.max_cards, 1, 0, 0, 0, visit_collect, &run.table);
+    }
+    run.jobs = malloc((run.table.size ? run.table.size : 1) * sizeof(SubsetEntry*));
+    for (size_t i = 0; i < run.table.capacity; i++) {
+        if (run.table.slots[i].key) run.jobs[run.job_count++] = &run.table.slots[i];
+    }
+    qsort(run.jobs, run.job_count, sizeof(SubsetEntry*), compare_jobs);
+
+    BatchWorker* workers = calloc(threads, sizeof(BatchWorker));
+    for (int t = 0; t < threads; t++) workers[t].run = &run;
+    for (int t = 1; t < threads; t++) pthread_create(&workers[t].thread, NULL, solve_worker, &workers[t]);
+    solve_worker(&workers[0]);
+    for (int t = 1; t < threads; t++) pthread_join(workers[t].thread, NULL);
+
+    // The other threads sum hands ahead; this one prints, summing
+    // whatever it reaches first
+    for (int t = 1; t < threads; t++) pthread_create(&workers[t].thread, NULL, sum_worker, &run);
+    for (size_t i = 0; i < run.line_count; i++) {
+        size_t h = run.line_hand[i];
+        if (claim_hand(&run, h)) sum_hand(&run, h);
+        while (atomic_load_explicit(&run.state[h], memory_order_acquire) != 2) {
+            nanosleep(&(struct timespec){0, 100000}, NULL);
+        }
+        summary_print(&run.summaries[h], run.hands[h], run.max_cards);
+    }
+    atomic_store(&run.next_line, run.line_count);
+    for (int t = 1; t < threads; t++) pthread_join(workers[t].thread, NULL);
+    fflush(stdout);
+
+    fprintf(stderr, "%zu hands (%zu distinct), %zu sub-multisets, %llu candidates tested in %.2f ms\n",
+            run.line_count, run.hand_count, run.job_count, (unsigned long long)run.tested, elapsed_ms(&start));
+    free(workers);
+    free(run.jobs);
+    analysis_free(&run.table);
+    free(run.line_hand);
+    free(run.hands);
+    free(run.summaries);
+    free(run.state);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int max_cards = DEFAULT_MAX_CARDS;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char* text = NULL;
+    const char* batch_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--max-cards=", 12) == 0) {
+            max_cards = atoi(argv[i] + 12);
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batch_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else {
+            text = argv[i];
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (batch_path) return run_batch(batch_path, max_cards, threads);
+    if (!text) {
+        fprintf(stderr, "差分解析:\n");
+        fprintf(stderr, "Usage: %s [--max-cards=K] カード\n", argv[0]);
+        fprintf(stderr, "       %s [--max-cards=K] [--threads=N] --batch=FILE|-  (1行1手札)\n", argv[0]);
+        fprintf(stderr, "stdin: +カード (引く)  -カード (出す)  =カード (手札を置き換え)  p (素数一覧)\n");
+        return 1;
+    }
+
+    Analysis a;
+    analysis_init(&a, max_cards);
+
+    char line[256];
+    snprintf(line, sizeof(line), "=%s", text);
+    do {
+        line[strcspn(line, "\r\n")] = '\0';
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        a.tested = 0;
+
+        if (line[0] == '=') {
+            int counts[14] = {0};
+            for (const char* p = line + 1; *p; p++) {
+                int r = parse_card(*p);
+                if (r > 0 && counts[r] < MAX_RANK_COUNT) counts[r]++;
+            }
+            analysis_set_hand(&a, counts);
+        } else if (line[0] == '+' || line[0] == '-') {
+            for (const char* p = line + 1; *p; p++) {
+                int r = parse_card(*p);
+                if (r <= 0) continue;
+                bool ok = line[0] == '+' ? analysis_add_card(&a, r) : analysis_remove_card(&a, r);
+                if (!ok) fprintf(stderr, "skipped %c\n", *p);
+            }
+        } else if (line[0] == 'p') {
+            print_primes(&a);
+            continue;
+        } else {
+            continue;
+        }
+
+        print_summary(&a);
+        fprintf(stderr, "%llu candidates tested in %.2f ms\n", a.tested, elapsed_ms(&start));
+        fflush(stdout);
+    } while (fgets(line, sizeof(line), stdin));
+
+    analysis_free(&a);
+    return 0;
+}
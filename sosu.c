@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+
+// Every tool in one binary. compile.sh builds each programN.c with main
+// renamed to programN_main and its other symbols made local, so the tools
+// share one copy of the engine and its CPU dispatch.
+int program_main(int argc, char** argv);
+int program2_main(int argc, char** argv);
+int program3_main(int argc, char** argv);
+int program4_main(int argc, char** argv);
+int program5_main(int argc, char** argv);
+int program6_main(int argc, char** argv);
+int program7_main(int argc, char** argv);
+int program8_main(int argc, char** argv);
+int program9_main(int argc, char** argv);
+int program10_main(int argc, char** argv);
+int program11_main(int argc, char** argv);
+int program12_main(int argc, char** argv);
+int program13_main(int argc, char** argv);
+int program14_main(int argc, char** argv);
+int autotune_main(int argc, char** argv);
+
+typedef struct {
+    const char* name;
+    int (*main)(int argc, char** argv);
+    const char* title;
+} Tool;
+
+static const Tool tools[] = {
+    {"program", program_main, "素数探索 (GMP, 並列)"},
+    {"program2", program2_main, "素因数分解"},
+    {"program3", program3_main, "素数"},
+    {"program4", program4_main, "素数v2"},
+    {"program5", program5_main, "2発出し"},
+    {"program6", program6_main, "初期砲"},
+    {"program7", program7_main, "素数v2 (統計)"},
+    {"program8", program8_main, "合成数出し"},
+    {"program9", program9_main, "差分解析"},
+    {"program10", program10_main, "素数索引"},
+    {"program11", program11_main, "素数計数"},
+    {"program12", program12_main, "終盤解析"},
+    {"program13", program13_main, "素数証明"},
+    {"program14", program14_main, "相手シミュレーション"},
+};
+#define TOOL_COUNT (int)(sizeof(tools) / sizeof(tools[0]))
+
+static const Tool* find_tool(const char* name) {
+    for (int i = 0; i < TOOL_COUNT; i++) {
+        if (strcmp(tools[i].name, name) == 0) return &tools[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    // Also callable through a symlink named after the tool
+    const char* base = strrchr(argv[0], '/');
+    const Tool* tool = find_tool(base ? base + 1 : argv[0]);
+    if (tool) return tool->main(argc, argv);
+
+    if (argc >= 2 && strcmp(argv[1], "cpu") == 0) {
+        printf("%s\n", engine_kernel());
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "autotune") == 0) return autotune_main(argc - 1, argv + 1);
+    if (argc >= 2 && (tool = find_tool(argv[1]))) return tool->main(argc - 1, argv + 1);
+
+    fprintf(stderr, "Usage: %s ツール [引数...]\n", argv[0]);
+    for (int i = 0; i < TOOL_COUNT; i++) fprintf(stderr, "  %-10s %s\n", tools[i].name, tools[i].title);
+    fprintf(stderr, "  %-10s 使用中の素数判定カーネル\n", "cpu");
+    fprintf(stderr, "  %-10s このマシン向けの調整ファイルを作成\n", "autotune");
+    return 1;
+}